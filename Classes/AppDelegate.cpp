@@ -3,10 +3,16 @@
 #include <time.h>
 #include <stdlib.h>
 #include "LoadingScene.h"
+#include "SoakTestScene.h"
+#include "CameraPathScene.h"
+#include "Benchmark.h"
+#include "UIConfig.h"
 #include "Utilities.h"
 
 USING_NS_CC;
 
+int AppDelegate::s_exitCode = EXIT_SUCCESS;
+
 AppDelegate::AppDelegate()
 {
 }
@@ -38,6 +44,50 @@ bool AppDelegate::applicationDidFinishLaunching()
   
   /* director->setDisplayStats(true); */
   
+  // JEVO_BENCHMARK=1 logs the times of the Buffer2D kernels and the diffs/s of the serial and the striped
+  // replay of config::workingFolder, JEVO_BENCHMARK=<folder> replays the folder. The application ends
+  // in the first frame, main returns the result
+  const char* benchmark = getenv("JEVO_BENCHMARK");
+  if (benchmark)
+  {
+    std::string folder = *benchmark && std::string(benchmark) != "1" ? benchmark : jevo::config::workingFolder;
+    bool result = jevo::benchmark::RunBuffer2D();
+    result = jevo::benchmark::RunDiffReplay(folder) && result;
+    SetExitCode(result ? EXIT_SUCCESS : EXIT_FAILURE);
+    director->end();
+    return true;
+  }
+  
+  // JEVO_SOAK_TEST=<folder> replays the folder without showing the window, see SoakTestScene
+  const char* soakTestFolder = getenv("JEVO_SOAK_TEST");
+  if (soakTestFolder)
+  {
+#if (CC_TARGET_PLATFORM == CC_PLATFORM_WIN32 || CC_TARGET_PLATFORM == CC_PLATFORM_MAC || CC_TARGET_PLATFORM == CC_PLATFORM_LINUX)
+    glfwHideWindow(static_cast<GLViewImpl*>(glview)->getWindow());
+#endif
+    director->setAnimationInterval(1.0 / 1000);
+    std::string folder = *soakTestFolder ? soakTestFolder : jevo::config::workingFolder;
+    auto scene = jevo::ui::SoakTestScene::createScene(folder);
+    if (!scene)
+      return false;
+    director->runWithScene(scene);
+    return true;
+  }
+  
+  // JEVO_CAMERA_PATH=<file> plays a camera path recorded with the R key and reports the frame times,
+  // see CameraPathScene. The frames are not limited by the display rate.
+  const char* cameraPathFile = getenv("JEVO_CAMERA_PATH");
+  if (cameraPathFile)
+  {
+    director->setAnimationInterval(1.0 / 1000);
+    std::string fileName = *cameraPathFile ? cameraPathFile : FileUtils::getInstance()->getWritablePath() + jevo::config::cameraPathFileName;
+    auto scene = jevo::ui::CameraPathScene::createScene(fileName);
+    if (!scene)
+      return false;
+    director->runWithScene(scene);
+    return true;
+  }
+  
   director->setAnimationInterval(1.0 / 60);
   auto scene = jevo::ui::LoadingScene::createScene();
   director->runWithScene(scene);
@@ -54,3 +104,13 @@ void AppDelegate::applicationWillEnterForeground()
 {
     Director::getInstance()->startAnimation();
 }
+
+void AppDelegate::SetExitCode(int exitCode)
+{
+  s_exitCode = exitCode;
+}
+
+int AppDelegate::GetExitCode()
+{
+  return s_exitCode;
+}
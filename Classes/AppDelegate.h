@@ -32,6 +32,15 @@ public:
     @param  the pointer of the application
     */
     virtual void applicationWillEnterForeground();
+
+    /**
+    @brief  The code returned by main, set by the scenes which end the application (the soak test, the camera path)
+    */
+    static void SetExitCode(int exitCode);
+    static int GetExitCode();
+
+private:
+    static int s_exitCode;
 };
 
 #endif // _APP_DELEGATE_H_
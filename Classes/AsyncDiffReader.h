@@ -3,18 +3,25 @@
 
 #include <cstdio>
 #include <fstream>
-#include <thread>
-#include <mutex>
-#include <condition_variable>
 #include "json_safe.hpp"
 #include "UICommon.h"
 #include "UIConfig.h"
 #include "Common.h"
 #include "Utilities.h"
+#include "Profiler.h"
+#include "JobSystem.h"
 
 namespace jevo
 {
   
+  enum class DiffType
+  {
+    Add,
+    Move,
+    Delete,
+    Paint
+  };
+  
   class DiffItem
   {
   public:
@@ -23,7 +30,9 @@ namespace jevo
     PixelPos destX = 0;
     PixelPos destY = 0;
     cocos2d::Color3B color;
-    std::string action;
+    // parsed from the action when the file is read, a diff of another action is skipped
+    DiffType type = DiffType::Add;
+    bool skipped = false;
     uint64_t id = -1;
     uint64_t updateNumber = -1;
   };
@@ -36,6 +45,8 @@ namespace jevo
     
     bool ReadFromFile(const std::string& fileName)
     {
+      PROFILE_ZONE("DiffSequence::ReadFromFile");
+      
       std::ifstream i(fileName);
       if (!i)
         return false;
@@ -56,7 +67,8 @@ namespace jevo
         item.sourseY = d["sy"];
         item.destX = d["dx"];
         item.destY = d["dy"];
-        item.action = d["a"];
+        std::string action = d["a"];
+        item.skipped = !ParseAction(action, item.type);
         item.id = d["id"];
         item.updateNumber = d["n"];
         item.color = graphic::ColorFromUint(d["c"]);
@@ -66,9 +78,25 @@ namespace jevo
       return true;
     }
     
+    // "add", "move" or "remove", false for the other actions
+    static bool ParseAction(const std::string& action, DiffType& type)
+    {
+      if (action == "add")
+        type = DiffType::Add;
+      else if (action == "move")
+        type = DiffType::Move;
+      else if (action == "remove")
+        type = DiffType::Delete;
+      else
+        return false;
+      return true;
+    }
+    
     DiffItemVector m_seq;
   };
   
+  // Reads the diff files one by one in background jobs of the JobSystem,
+  // the next file is read and parsed while the diffs of the previous one are played.
   class AsyncDiffReader
   {
   public:
@@ -79,62 +107,49 @@ namespace jevo
     bool Init(const std::string& workingFolder)
     {
       m_wordkingFolder = workingFolder;
-      m_thread = std::thread(&AsyncDiffReader::WorkerThread, this);
       return true;
     }
     
     ~AsyncDiffReader()
     {
-      m_thread.join();
+      Stop();
     }
     
-    void WorkerThread()
+    void ReadNextFile()
     {
-      while (1)
+      PROFILE_ZONE("AsyncDiffReader::ReadNextFile");
+      
+      m_lastUpdateDuration = 0.0;
+      
+      std::string filePath = GetFileName(m_wordkingFolder, m_fileIndex);
+      
+      if (m_updates.ReadFromFile(filePath))
       {
+        m_fileIndex += 1;
+        if (jevo::config::removeFiles)
         {
-          std::unique_lock<std::mutex> lk(m_lock);
-          m_semaphore.wait(lk, [this]
-                           {
-                             return m_performUpdate || m_shouldStop;
-                           });
-          
-          if (m_shouldStop)
-          {
-            return;
-          }
-          
-          m_inProccess = true;
-          m_performUpdate = false;
-        }
-        
-        m_lastUpdateDuration = 0.0;
-        
-        std::string filePath = m_wordkingFolder;
-        std::stringstream stream;
-        stream << std::setfill('0') << std::setw(4) << m_fileIndex;
-        filePath += "/" + stream.str() + ".json";
-        
-        if (m_updates.ReadFromFile(filePath))
-        {
-          m_fileIndex += 1;
-          if (jevo::config::removeFiles)
-          {
-            std::remove(filePath.c_str());
-          }
-        }
-
-        {
-          std::lock_guard<std::mutex> lk(m_lock);
-          m_inProccess = false;
+          std::remove(filePath.c_str());
         }
       }
     }
     
+    // file of the diffs with the given index in the folder
+    static std::string GetFileName(const std::string& workingFolder, unsigned int index)
+    {
+      std::stringstream stream;
+      stream << std::setfill('0') << std::setw(4) << index;
+      return workingFolder + "/" + stream.str() + ".json";
+    }
+    
     bool IsAvailable()
     {
-      std::lock_guard<std::mutex> lk(m_lock);
-      return !m_inProccess;
+      return !m_job || m_job->IsFinished();
+    }
+    
+    // diffs of the file which is read and not popped yet
+    size_t GetNumberOfReadyDiffs()
+    {
+      return IsAvailable() ? m_updates.m_seq.size() : 0;
     }
     
     double GetLastUpdateTime()
@@ -144,16 +159,25 @@ namespace jevo
     
     void LoadNext()
     {
-      std::lock_guard<std::mutex> lk(m_lock);
-      m_performUpdate = true;
-      m_semaphore.notify_one();
+      assert(IsAvailable());
+      if (m_shouldStop)
+        return;
+      
+      m_job = JobSystem::GetShared().ScheduleBackground([this]
+                                                        {
+                                                          ReadNextFile();
+                                                        });
     }
     
+    // waits for the file which is being read
     void Stop()
     {
-      std::lock_guard<std::mutex> lk(m_lock);
       m_shouldStop = true;
-      m_semaphore.notify_one();
+      if (m_job)
+      {
+        JobSystem::GetShared().Wait(m_job);
+        m_job = nullptr;
+      }
     }
     
     void PopDiffs(DiffItemVector& output)
@@ -163,16 +187,11 @@ namespace jevo
     }
     
   private:
-    bool m_performUpdate = false;
     bool m_shouldStop = false;
-    bool m_inProccess = false;
-    double m_lastUpdateDuration;
+    double m_lastUpdateDuration = 0.0;
     unsigned int m_fileIndex = 0;
     std::string m_wordkingFolder;
-    std::mutex m_lock;
-    std::condition_variable m_semaphore;
-    std::thread m_thread;
+    JobSystem::JobPtr m_job; // reads the next file
     DiffSequence m_updates;
   };
 }
-
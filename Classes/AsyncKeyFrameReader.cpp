@@ -1,11 +1,15 @@
 
 #include "AsyncKeyFrameReader.h"
+#include "Profiler.h"
+#include "Counters.h"
 
 namespace jevo
 {
   bool AsyncKeyFrameReader::ReadFromFile(const std::string& fileName,
                                          BufferTypePtr& buffer)
   {
+    PROFILE_ZONE("AsyncKeyFrameReader::ReadFromFile");
+    
     std::ifstream i(fileName);
     if (!i)
       return false;
@@ -19,14 +23,11 @@ namespace jevo
     PixelPos width = json["width"];
     PixelPos height = json["height"];
     
+    // whole maps of kSegmentSize, the chunks are allocated only for the organizms
     width = std::ceil(width / 50.f) * 50;
     height = std::ceil(height / 50.f) * 50;
     
     buffer = std::make_shared<BufferType>(width, height);
-    buffer->ForEach([](const int& x, const int& y, GreatPixel& value)
-                      {
-                        value.pos = Vec2(x, y);
-                      });
     
     for (const auto& item : json["region"])
     {
@@ -41,13 +42,21 @@ namespace jevo
       auto color = graphic::ColorFromUint(colorValue);
       assert(color != cocos2d::Color3B());
       
-      GreatPixel* bufferItem = nullptr;
-      if (!buffer->Get(x, y, &bufferItem))
+      GreatPixel* bufferItem = buffer->GetOrCreate(x, y);
+      if (!bufferItem)
         return false;
       
-      auto organizm = std::make_shared<Organizm>(id, bufferItem, color);
-      
-      bufferItem->organizm = organizm;
+      if (id == Organizm::EnergyId)
+      {
+        bufferItem->energy = true;
+        bufferItem->energyColor = color;
+        counters::Add(counters::Counter::EnergyCells);
+      }
+      else
+      {
+        bufferItem->organizm = std::make_shared<Organizm>(id, bufferItem, color);
+      }
+      buffer->Occupy(bufferItem);
     }
     
     return true;
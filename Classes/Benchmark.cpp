@@ -0,0 +1,309 @@
+//
+//  Benchmark.cpp
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#include "Benchmark.h"
+#include "Buffer2D.h"
+#include "WorldModel.h"
+#include "JobSystem.h"
+#include "UIConfig.h"
+#include "Logging.h"
+#include <chrono>
+#include <cstring>
+
+namespace jevo
+{
+  namespace benchmark
+  {
+    namespace
+    {
+      using ColorBuffer = Buffer2D<cocos2d::Color4B>;
+
+      // the best of config::benchmarkRuns, milliseconds
+      template <typename F>
+      float Measure(F&& function)
+      {
+        float best = 0.f;
+        for (unsigned int i = 0; i < config::benchmarkRuns; ++i)
+        {
+          auto startTime = std::chrono::steady_clock::now();
+          function();
+          std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - startTime;
+          best = i == 0 ? elapsed.count() : std::min(best, elapsed.count());
+        }
+        return best;
+      }
+
+      bool Equal(const ColorBuffer& a, const ColorBuffer& b)
+      {
+        return a.GetWidth() == b.GetWidth() &&
+               a.GetHeight() == b.GetHeight() &&
+               std::memcmp(a.GetData(), b.GetData(), a.GetWidth() * a.GetHeight() * sizeof(cocos2d::Color4B)) == 0;
+      }
+
+      bool Report(const char* name, float referenceTime, float kernelTime, bool equal)
+      {
+        KOMORKI_LOG("Benchmark: %-10s per value: %8.2fms kernel: %8.2fms x%.1f %s",
+                    name, referenceTime, kernelTime, referenceTime / std::max(kernelTime, 0.001f), equal ? "" : "MISMATCH");
+        return equal;
+      }
+      
+      struct ReplayPath
+      {
+        const char* name = "";
+        WorldModel model;
+        WorldModelDiffBuckets buckets;
+        double time = 0.0; // seconds of PerformUpdates
+      };
+      
+      bool Equal(const OrganizmPtr& a, const OrganizmPtr& b)
+      {
+        if (!a || !b)
+          return !a && !b;
+        return a->GetId() == b->GetId() && a->GetColor() == b->GetColor() && a->GetPosition() == b->GetPosition();
+      }
+      
+      bool Equal(const WorldModelDiff& a, const WorldModelDiff& b)
+      {
+        return a.type == b.type &&
+               Equal(a.organizm, b.organizm) &&
+               a.sourcePos == b.sourcePos &&
+               a.destinationPos == b.destinationPos &&
+               a.destinationPixel->pos == b.destinationPixel->pos &&
+               a.energy == b.energy &&
+               (!a.energy || a.energyColor == b.energyColor);
+      }
+      
+      bool Equal(const WorldModelDiffVect& a, const WorldModelDiffVect& b)
+      {
+        if (a.size() != b.size())
+          return false;
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+          if (!Equal(a[i], b[i]))
+            return false;
+        }
+        return true;
+      }
+      
+      bool Equal(const WorldModelDiffBuckets& a, const WorldModelDiffBuckets& b)
+      {
+        if (a.GetBucketCount() != b.GetBucketCount() || !Equal(a.GetCrossChunkMoves(), b.GetCrossChunkMoves()))
+          return false;
+        for (size_t i = 0; i < a.GetBucketCount(); ++i)
+        {
+          if (a.GetBucket(i).chunkIndex != b.GetBucket(i).chunkIndex || !Equal(a.GetBucket(i).diffs, b.GetBucket(i).diffs))
+            return false;
+        }
+        return true;
+      }
+      
+      // the occupied cells of every chunk and the organizm and the energy of every cell
+      bool Equal(const SparseWorld& a, const SparseWorld& b)
+      {
+        if (a.GetNumberOfChunks() != b.GetNumberOfChunks())
+          return false;
+        for (size_t index = 0; index < a.GetNumberOfChunks(); ++index)
+        {
+          if (a.GetOccupiedCells(index) != b.GetOccupiedCells(index))
+            return false;
+          if (a.GetOccupiedCells(index) < 0)
+            continue;
+          
+          Vec2 origin = a.GetChunkOrigin(index);
+          for (PixelPos y = origin.y; y < origin.y + SparseWorld::kChunkSize; ++y)
+          {
+            for (PixelPos x = origin.x; x < origin.x + SparseWorld::kChunkSize; ++x)
+            {
+              const GreatPixel* cellA = a.Get(x, y);
+              const GreatPixel* cellB = b.Get(x, y);
+              if (!Equal(cellA->organizm, cellB->organizm) ||
+                  cellA->energy != cellB->energy ||
+                  (cellA->energy && cellA->energyColor != cellB->energyColor))
+                return false;
+            }
+          }
+        }
+        return true;
+      }
+    }
+
+    //********************************************************************************************
+    bool RunBuffer2D()
+    {
+      const int size = config::benchmarkGridSize;
+      ColorBuffer source(size, size);
+      source.ForEach([](const int& x, const int& y, cocos2d::Color4B& value)
+                     {
+                       value = cocos2d::Color4B(x * 7, y * 13, (x ^ y) & 0xff, 255);
+                     });
+
+      bool result = true;
+
+      {
+        const int offset = size / 4;
+        ColorBuffer reference(size / 2, size / 2);
+        ColorBuffer kernel(size / 2, size / 2);
+        float referenceTime = Measure([&]()
+        {
+          for (int i = 0; i < reference.GetWidth(); ++i)
+          {
+            for (int j = 0; j < reference.GetHeight(); ++j)
+            {
+              reference.Set(i, j, source.GetWithDefault(i + offset, j + offset, cocos2d::Color4B()));
+            }
+          }
+        });
+        float kernelTime = Measure([&]() { source.SubSet(offset, offset, kernel); });
+        result = Report("subset", referenceTime, kernelTime, Equal(reference, kernel)) && result;
+      }
+
+      {
+        const unsigned int scale = 4;
+        const int thumbnailSize = size / 8;
+        ColorBuffer thumbnail(thumbnailSize, thumbnailSize);
+        source.SubSet(0, 0, thumbnail);
+        ColorBuffer reference(thumbnailSize * scale, thumbnailSize * scale);
+        ColorBuffer kernel(thumbnailSize * scale, thumbnailSize * scale);
+        float referenceTime = Measure([&]()
+        {
+          for (int i = 0; i < reference.GetWidth(); ++i)
+          {
+            for (int j = 0; j < reference.GetHeight(); ++j)
+            {
+              reference.Set(i, j, thumbnail.GetWithDefault(i / scale, j / scale, cocos2d::Color4B()));
+            }
+          }
+        });
+        float kernelTime = Measure([&]() { thumbnail.Scale(scale, kernel); });
+        result = Report("upscale", referenceTime, kernelTime, Equal(reference, kernel)) && result;
+      }
+
+      {
+        const int factor = 4;
+        const int downscaledSize = (size + factor - 1) / factor;
+        ColorBuffer reference(downscaledSize, downscaledSize);
+        ColorBuffer kernel(downscaledSize, downscaledSize);
+        float referenceTime = Measure([&]()
+        {
+          for (int i = 0; i < reference.GetWidth(); ++i)
+          {
+            for (int j = 0; j < reference.GetHeight(); ++j)
+            {
+              unsigned int r = 0, g = 0, b = 0, a = 0, count = 0;
+              for (int x = i * factor; x < std::min(i * factor + factor, size); ++x)
+              {
+                for (int y = j * factor; y < std::min(j * factor + factor, size); ++y)
+                {
+                  cocos2d::Color4B color;
+                  source.Get(x, y, color);
+                  r += color.r; g += color.g; b += color.b; a += color.a;
+                  count += 1;
+                }
+              }
+              reference.Set(i, j, cocos2d::Color4B(r / count, g / count, b / count, a / count));
+            }
+          }
+        });
+        float kernelTime = Measure([&]() { source.Downscale(factor, kernel); });
+        result = Report("downscale", referenceTime, kernelTime, Equal(reference, kernel)) && result;
+      }
+
+      {
+        const cocos2d::Color4B color(10, 20, 30, 255);
+        ColorBuffer reference(size, size);
+        ColorBuffer kernel(size, size);
+        float referenceTime = Measure([&]()
+        {
+          for (int i = 0; i < size; ++i)
+          {
+            for (int j = 0; j < size; ++j)
+            {
+              reference.Set(i, j, color);
+            }
+          }
+        });
+        float kernelTime = Measure([&]() { kernel.FillRect(0, 0, size, size, color); });
+        result = Report("fill", referenceTime, kernelTime, Equal(reference, kernel)) && result;
+      }
+
+      return result;
+    }
+    
+    //********************************************************************************************
+    bool RunDiffReplay(const std::string& workingFolder)
+    {
+      ReplayPath paths[2];
+      paths[0].name = "serial";
+      paths[0].model.m_stripedUpdates = false;
+      paths[1].name = "striped";
+      for (auto& path : paths)
+      {
+        if (!path.model.Init(workingFolder))
+        {
+          KOMORKI_LOG("Benchmark: no keyframe in %s, the diff replay is skipped", workingFolder.c_str());
+          return true;
+        }
+      }
+      
+      // every diff is reported
+      const Rect worldRect(Vec2(), paths[0].model.GetSize());
+      uint64_t diffs = 0;
+      unsigned int updates = 0;
+      unsigned int fileIndex = 0;
+      DiffSequence sequence;
+      for (; sequence.ReadFromFile(AsyncDiffReader::GetFileName(workingFolder, fileIndex)); ++fileIndex)
+      {
+        for (auto& path : paths)
+        {
+          path.model.m_pendingDiffs = sequence.m_seq;
+          path.model.m_currentPosInDiffs = 0;
+        }
+        
+        while (!paths[0].model.m_pendingDiffs.empty())
+        {
+          unsigned int played[2];
+          for (int i = 0; i < 2; ++i)
+          {
+            ReplayPath& path = paths[i];
+            auto startTime = std::chrono::steady_clock::now();
+            played[i] = path.model.PerformUpdates(config::warpUpdatesPerStep, worldRect, path.buckets);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+            path.time += elapsed.count();
+          }
+          
+          if (played[0] != played[1] || !Equal(paths[0].buckets, paths[1].buckets))
+          {
+            KOMORKI_LOG("Benchmark: the diffs of update %u of file %u differ, MISMATCH", updates, fileIndex);
+            return false;
+          }
+          diffs += played[0];
+          updates += 1;
+        }
+        
+        if (!Equal(*paths[0].model.m_map, *paths[1].model.m_map))
+        {
+          KOMORKI_LOG("Benchmark: the worlds differ after file %u, MISMATCH", fileIndex);
+          return false;
+        }
+      }
+      
+      KOMORKI_LOG("Benchmark: replay of %u files, %llu diffs in %u updates, %u workers",
+                  fileIndex, static_cast<unsigned long long>(diffs), updates, JobSystem::GetShared().GetNumberOfWorkers());
+      for (const auto& path : paths)
+      {
+        KOMORKI_LOG("Benchmark: %-10s %12.0f diffs/s", path.name, diffs / std::max(path.time, 0.000001));
+      }
+      KOMORKI_LOG("Benchmark: striped x%.2f", paths[0].time / std::max(paths[1].time, 0.000001));
+      
+      for (auto& path : paths)
+      {
+        path.model.Stop();
+      }
+      return true;
+    }
+  }
+}
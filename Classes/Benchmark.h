@@ -0,0 +1,26 @@
+//
+//  Benchmark.h
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#pragma once
+
+#include <string>
+
+namespace jevo
+{
+  namespace benchmark
+  {
+    // Times the Buffer2D kernels against per-value loops through Get/Set on a color grid
+    // of config::benchmarkGridSize, checks that both give the same result and logs the times.
+    // Returns false when a kernel gives a different result.
+    bool RunBuffer2D();
+    // Replays the diff files of the folder on two world models, one plays the updates serially and
+    // the other one in the stripes, compares the reported diffs after every update and the cells and
+    // the chunks after every file, logs the diffs/s of both. Returns false when they differ,
+    // a folder without a keyframe is skipped.
+    bool RunDiffReplay(const std::string& workingFolder);
+  }
+}
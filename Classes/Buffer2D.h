@@ -9,11 +9,19 @@
 #pragma once
 
 #include <vector>
-#include <functional>
+#include <algorithm>
 #include <memory>
+#include <sstream>
+#include <type_traits>
+#include <cassert>
+#include <cstdint>
+#include "JobSystem.h"
 
 namespace jevo
 {
+  // Values in row-major order, the kernels below walk whole rows. There is no tiled layout:
+  // the world is kept in SparseWorld chunks, which are already contiguous 50x50 blocks, and the
+  // color pyramid levels and the chunk textures are read and written row by row
   template <typename T, typename S = int>
   class Buffer2D
   {
@@ -27,6 +35,8 @@ namespace jevo
     
     inline S GetWidth () const { return width; }
     inline S GetHeight () const { return height; }
+    inline T* GetData () { return buff.data(); }
+    inline const T* GetData () const { return buff.data(); }
     
     inline bool Set(const S& x, const S& y, const T& value)
     {
@@ -76,60 +86,168 @@ namespace jevo
       return GetInternal(x, y);
     }
     
-    typedef std::function<void(const S& x, const S& y, T& value)> OnValue;
-    inline void ForEach(const OnValue& onValue)
+    // onValue(x, y, value) is called row by row, in the order of the memory
+    template <typename F>
+    inline void ForEach(F&& onValue)
     {
-      for (int i = 0; i < width; ++i)
+      ForEachInRect(0, 0, width, height, onValue);
+    }
+    
+    template <typename F>
+    inline void ForEach(F&& onValue) const
+    {
+      ForEachInRect(0, 0, width, height, onValue);
+    }
+    
+    // the rect is clipped by the buffer
+    template <typename F>
+    inline void ForEachInRect(const S& x, const S& y, const S& w, const S& h, F&& onValue)
+    {
+      S x1 = std::max<S>(x, 0), x2 = std::min<S>(x + w, width);
+      S y1 = std::max<S>(y, 0), y2 = std::min<S>(y + h, height);
+      for (S j = y1; j < y2; ++j)
+      {
+        T* row = buff.data() + j * width;
+        for (S i = x1; i < x2; ++i)
+        {
+          onValue(i, j, row[i]);
+        }
+      }
+    }
+    
+    template <typename F>
+    inline void ForEachInRect(const S& x, const S& y, const S& w, const S& h, F&& onValue) const
+    {
+      S x1 = std::max<S>(x, 0), x2 = std::min<S>(x + w, width);
+      S y1 = std::max<S>(y, 0), y2 = std::min<S>(y + h, height);
+      for (S j = y1; j < y2; ++j)
       {
-        for (int j = 0; j < height; ++j)
+        const T* row = buff.data() + j * width;
+        for (S i = x1; i < x2; ++i)
         {
-          onValue(i, j, GetInternal(i, j));
+          onValue(i, j, row[i]);
         }
       }
     }
     
+    // the rows are split into bands of rowsPerBand visited by the jobs of JobSystem::GetShared() and the
+    // calling thread. onValue is called concurrently, it may only touch the value and state shared for reading
+    template <typename F>
+    inline void ParallelForEach(F&& onValue, S rowsPerBand = 64)
+    {
+      rowsPerBand = std::max<S>(rowsPerBand, 1);
+      size_t numberOfBands = static_cast<size_t>((height + rowsPerBand - 1) / rowsPerBand);
+      JobSystem::GetShared().ParallelFor(numberOfBands, [this, rowsPerBand, &onValue](size_t band)
+                                         {
+                                           ForEachInRect(0, static_cast<S>(band) * rowsPerBand, width, rowsPerBand, onValue);
+                                         });
+    }
+    
+    // the rows are copied as ranges, it is a memmove for trivially copyable types
     inline bool SubSet(const S& _x, const S& _y, Buffer2D<T>& bufferOut) const
     {
       if (!IsInside(_x, _y) || !IsInside(_x + bufferOut.GetWidth() - 1, _y + bufferOut.GetHeight() - 1)) return false;
       
-      for (int i = 0; i < bufferOut.GetWidth(); ++i)
+      for (S j = 0; j < bufferOut.GetHeight(); ++j)
       {
-        for (int j = 0; j < bufferOut.GetHeight(); ++j)
-        {
-          bufferOut.Set(i, j, GetInternal(i + _x, j + _y));
-        }
+        const T* row = buff.data() + _x + (j + _y) * width;
+        std::copy(row, row + bufferOut.GetWidth(), bufferOut.GetData() + j * bufferOut.GetWidth());
       }
       return true;
     }
     
+    // nearest neighbour, a value becomes a scale x scale square, bufferOut is filled up to its size.
+    // a row is expanded once and copied to the other scale - 1 rows
     inline void Scale(unsigned int scale, Buffer2D<T>& bufferOut) const
     {
-      Buffer2D<T> result(width * scale, height * scale);
-      for (int i = 0; i < width; ++i)
+      S outWidth = std::min<S>(width * scale, bufferOut.GetWidth());
+      S outHeight = std::min<S>(height * scale, bufferOut.GetHeight());
+      T* out = bufferOut.GetData();
+      S outStride = bufferOut.GetWidth();
+      
+      for (S y = 0; y < outHeight; y += scale)
+      {
+        const T* row = buff.data() + (y / scale) * width;
+        T* outRow = out + y * outStride;
+        for (S x = 0; x < outWidth; x += scale)
+        {
+          std::fill(outRow + x, outRow + std::min<S>(x + scale, outWidth), row[x / scale]);
+        }
+        
+        for (S j = y + 1; j < std::min<S>(y + scale, outHeight); ++j)
+        {
+          std::copy(outRow, outRow + outWidth, out + j * outStride);
+        }
+      }
+    }
+    
+    // averages factor x factor squares byte by byte, so T has to be a set of 8 bit channels
+    // like a color. bufferOut is ceil(width / factor) x ceil(height / factor), the squares
+    // on the right and top borders average the values they have
+    inline void Downscale(unsigned int factor, Buffer2D<T>& bufferOut) const
+    {
+      static_assert(std::is_trivially_copyable<T>::value, "Downscale averages the bytes of the values");
+      assert(factor > 0);
+      assert(bufferOut.GetWidth() == static_cast<S>((width + factor - 1) / factor));
+      assert(bufferOut.GetHeight() == static_cast<S>((height + factor - 1) / factor));
+      
+      const unsigned int channels = sizeof(T);
+      S outWidth = bufferOut.GetWidth();
+      std::vector<uint32_t> sums(outWidth * channels);
+      
+      for (S outY = 0; outY < bufferOut.GetHeight(); ++outY)
       {
-        for (int j = 0; j < height; ++j)
+        std::fill(sums.begin(), sums.end(), 0);
+        S y1 = outY * factor, y2 = std::min<S>(y1 + factor, height);
+        
+        for (S y = y1; y < y2; ++y)
         {
-          T value = GetInternal(i, j);
-          
-          for (int iScale = 0; iScale < scale; ++iScale)
+          const uint8_t* row = reinterpret_cast<const uint8_t*>(buff.data() + y * width);
+          for (S outX = 0; outX < outWidth; ++outX)
           {
-            for (int jScale = 0; jScale < scale; ++jScale)
+            uint32_t* sum = sums.data() + outX * channels;
+            S x1 = outX * factor, x2 = std::min<S>(x1 + factor, width);
+            for (const uint8_t* value = row + x1 * channels; value < row + x2 * channels; value += channels)
             {
-              bufferOut.Set(i * scale + iScale, j * scale + jScale, value);
+              for (unsigned int c = 0; c < channels; ++c)
+              {
+                sum[c] += value[c];
+              }
             }
           }
         }
+        
+        uint8_t* outRow = reinterpret_cast<uint8_t*>(bufferOut.GetData() + outY * outWidth);
+        for (S outX = 0; outX < outWidth; ++outX)
+        {
+          S x1 = outX * factor;
+          uint32_t count = (std::min<S>(x1 + factor, width) - x1) * (y2 - y1);
+          for (unsigned int c = 0; c < channels; ++c)
+          {
+            outRow[outX * channels + c] = static_cast<uint8_t>(sums[outX * channels + c] / count);
+          }
+        }
       }
     }
     
     inline void Fill(const T& value)
     {
-      for (int i = 0; i < width; ++i)
+      std::fill(buff.begin(), buff.end(), value);
+    }
+    
+    // the rect is clipped by the buffer, the first row is filled and copied to the others
+    inline void FillRect(const S& x, const S& y, const S& w, const S& h, const T& value)
+    {
+      S x1 = std::max<S>(x, 0), x2 = std::min<S>(x + w, width);
+      S y1 = std::max<S>(y, 0), y2 = std::min<S>(y + h, height);
+      if (x1 >= x2 || y1 >= y2)
+        return;
+      
+      T* first = buff.data() + x1 + y1 * width;
+      std::fill(first, first + (x2 - x1), value);
+      for (S j = y1 + 1; j < y2; ++j)
       {
-        for (int j = 0; j < height; ++j)
-        {
-          SetInternal(i, j, value);
-        }
+        std::copy(first, first + (x2 - x1), buff.data() + x1 + j * width);
       }
     }
     
@@ -172,6 +290,11 @@ namespace jevo
       return buff[x + y * width];
     }
     
+    inline const T& GetInternal(const S& x, const S& y) const
+    {
+      return buff[x + y * width];
+    }
+    
     std::vector<T> buff;
     S width;
     S height;
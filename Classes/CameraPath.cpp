@@ -0,0 +1,198 @@
+//
+//  CameraPath.cpp
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#include "CameraPath.h"
+#include "json_safe.hpp"
+#include <cassert>
+#include <fstream>
+
+namespace jevo
+{
+  namespace
+  {
+    const char* GetTypeName(CameraPath::EventType type)
+    {
+      switch (type)
+      {
+        case CameraPath::EventType::Move: return "move";
+        case CameraPath::EventType::Zoom: return "zoom";
+        case CameraPath::EventType::Tick: return "tick";
+      }
+      assert(false);
+      return "";
+    }
+
+    bool GetType(const std::string& name, CameraPath::EventType& type)
+    {
+      for (auto t : {CameraPath::EventType::Move, CameraPath::EventType::Zoom, CameraPath::EventType::Tick})
+      {
+        if (name == GetTypeName(t))
+        {
+          type = t;
+          return true;
+        }
+      }
+      return false;
+    }
+  }
+
+  //********************************************************************************************
+  void CameraPath::Start(const std::string& workingFolder,
+                         uint64_t playedDiffs,
+                         const cocos2d::Size& viewSize,
+                         const cocos2d::Vec2& cameraOrigin,
+                         float cameraScale,
+                         float updateTime)
+  {
+    m_workingFolder = workingFolder;
+    m_playedDiffs = playedDiffs;
+    m_viewSize = viewSize;
+    m_cameraOrigin = cameraOrigin;
+    m_cameraScale = cameraScale;
+    m_updateTime = updateTime;
+    m_events.clear();
+    m_time = 0.f;
+  }
+
+  //********************************************************************************************
+  void CameraPath::Update(float dt)
+  {
+    m_time += dt;
+  }
+
+  //********************************************************************************************
+  void CameraPath::RecordMove(const cocos2d::Vec2& offset)
+  {
+    Event event;
+    event.time = m_time;
+    event.type = EventType::Move;
+    event.point = offset;
+    m_events.push_back(event);
+  }
+
+  //********************************************************************************************
+  void CameraPath::RecordZoom(const cocos2d::Vec2& point, float scaleOffset)
+  {
+    Event event;
+    event.time = m_time;
+    event.type = EventType::Zoom;
+    event.point = point;
+    event.scaleOffset = scaleOffset;
+    m_events.push_back(event);
+  }
+
+  //********************************************************************************************
+  void CameraPath::RecordTick(unsigned int diffs)
+  {
+    if (diffs == 0)
+      return;
+
+    Event event;
+    event.time = m_time;
+    event.type = EventType::Tick;
+    event.diffs = diffs;
+    m_events.push_back(event);
+  }
+
+  //********************************************************************************************
+  float CameraPath::GetDuration() const
+  {
+    return m_events.empty() ? 0.f : m_events.back().time;
+  }
+
+  //********************************************************************************************
+  bool CameraPath::Save(const std::string& fileName) const
+  {
+    nlohmann::json json;
+    json["folder"] = m_workingFolder;
+    json["playedDiffs"] = m_playedDiffs;
+    json["viewSize"] = {m_viewSize.width, m_viewSize.height};
+    json["cameraOrigin"] = {m_cameraOrigin.x, m_cameraOrigin.y};
+    json["cameraScale"] = m_cameraScale;
+    json["updateTime"] = m_updateTime;
+
+    nlohmann::json events = nlohmann::json::array();
+    for (const auto& event : m_events)
+    {
+      nlohmann::json e;
+      e["t"] = event.time;
+      e["type"] = GetTypeName(event.type);
+      switch (event.type)
+      {
+        case EventType::Move:
+          e["x"] = event.point.x;
+          e["y"] = event.point.y;
+          break;
+        case EventType::Zoom:
+          e["x"] = event.point.x;
+          e["y"] = event.point.y;
+          e["offset"] = event.scaleOffset;
+          break;
+        case EventType::Tick:
+          e["diffs"] = event.diffs;
+          break;
+      }
+      events.push_back(e);
+    }
+    json["events"] = events;
+
+    std::ofstream o(fileName);
+    if (!o)
+      return false;
+
+    o << json.dump(1) << std::endl;
+    return o.good();
+  }
+
+  //********************************************************************************************
+  bool CameraPath::Load(const std::string& fileName)
+  {
+    std::ifstream i(fileName);
+    if (!i)
+      return false;
+
+    nlohmann::json json;
+    i >> json;
+
+    if (json.is_null())
+      return false;
+
+    m_workingFolder = json["folder"].get<std::string>();
+    m_playedDiffs = json["playedDiffs"];
+    m_viewSize = cocos2d::Size(json["viewSize"][0].get<float>(), json["viewSize"][1].get<float>());
+    m_cameraOrigin = cocos2d::Vec2(json["cameraOrigin"][0].get<float>(), json["cameraOrigin"][1].get<float>());
+    m_cameraScale = json["cameraScale"];
+    m_updateTime = json["updateTime"];
+
+    m_events.clear();
+    for (const auto& e : json["events"])
+    {
+      Event event;
+      if (!GetType(e["type"].get<std::string>(), event.type))
+        return false;
+
+      event.time = e["t"];
+      switch (event.type)
+      {
+        case EventType::Move:
+          event.point = cocos2d::Vec2(e["x"].get<float>(), e["y"].get<float>());
+          break;
+        case EventType::Zoom:
+          event.point = cocos2d::Vec2(e["x"].get<float>(), e["y"].get<float>());
+          event.scaleOffset = e["offset"];
+          break;
+        case EventType::Tick:
+          event.diffs = e["diffs"];
+          break;
+      }
+      m_events.push_back(event);
+    }
+
+    m_time = GetDuration();
+    return true;
+  }
+}
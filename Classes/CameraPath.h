@@ -0,0 +1,68 @@
+//
+//  CameraPath.h
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "cocos2d.h"
+
+namespace jevo
+{
+  // Moves and zooms of the camera and ticks of the simulation with the time they happened at.
+  // The path starts from a camera and a number of played diffs, so it can be played again
+  // against the same folder, see ui::CameraPathScene.
+  class CameraPath
+  {
+  public:
+
+    enum class EventType
+    {
+      Move, // point is the offset
+      Zoom, // point is the zoom center on the screen
+      Tick  // diffs are played
+    };
+
+    struct Event
+    {
+      float time = 0.f; // seconds since the start of the path
+      EventType type = EventType::Move;
+      cocos2d::Vec2 point;
+      float scaleOffset = 0.f;
+      unsigned int diffs = 0;
+    };
+
+    void Start(const std::string& workingFolder,
+               uint64_t playedDiffs,
+               const cocos2d::Size& viewSize,
+               const cocos2d::Vec2& cameraOrigin,
+               float cameraScale,
+               float updateTime);
+    // advances the time of the next events
+    void Update(float dt);
+    void RecordMove(const cocos2d::Vec2& offset);
+    void RecordZoom(const cocos2d::Vec2& point, float scaleOffset);
+    void RecordTick(unsigned int diffs);
+    // time of the last event
+    float GetDuration() const;
+
+    bool Save(const std::string& fileName) const;
+    bool Load(const std::string& fileName);
+
+    std::string m_workingFolder;
+    uint64_t m_playedDiffs = 0; // diffs played before the start
+    cocos2d::Size m_viewSize;
+    cocos2d::Vec2 m_cameraOrigin; // world points, see graphic::Viewport::GetCameraOrigin
+    float m_cameraScale = 1.f;
+    float m_updateTime = 0.f; // animation time of the ticks
+    std::vector<Event> m_events;
+
+  private:
+
+    float m_time = 0.f;
+  };
+}
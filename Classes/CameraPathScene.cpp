@@ -0,0 +1,271 @@
+//
+//  CameraPathScene.cpp
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#include "CameraPathScene.h"
+#include "WorldModel.h"
+#include "UIConfig.h"
+#include "Logging.h"
+#include "Counters.h"
+#include "AppDelegate.h"
+#include "json_safe.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+
+USING_NS_CC;
+
+namespace jevo
+{
+  namespace ui
+  {
+    namespace
+    {
+      float Seconds(const std::chrono::steady_clock::time_point& startTime)
+      {
+        std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - startTime;
+        return elapsed.count();
+      }
+
+      // values are sorted
+      float Percentile(const std::vector<float>& values, float percentile)
+      {
+        if (values.empty())
+          return 0.f;
+        size_t index = std::min(values.size() - 1, static_cast<size_t>(percentile * values.size()));
+        return values[index];
+      }
+    }
+
+    CameraPathScene::~CameraPathScene()
+    {
+      if (m_worldModel) m_worldModel->Stop();
+      if (m_rootNode) m_rootNode->release();
+    }
+
+    bool CameraPathScene::init(const std::string& pathFileName)
+    {
+      if ( !Layer::init() )
+      {
+        return false;
+      }
+
+      m_pathFileName = pathFileName;
+      if (!m_path.Load(pathFileName))
+      {
+        KOMORKI_LOG("CameraPath: failed to load %s", pathFileName.c_str());
+        return false;
+      }
+
+      m_worldModel = std::make_shared<WorldModel>();
+      if (!m_worldModel->Init(m_path.m_workingFolder))
+      {
+        KOMORKI_LOG("CameraPath: no keyframe.json in %s", m_path.m_workingFolder.c_str());
+        return false;
+      }
+
+      m_rootNode = Node::create();
+      m_rootNode->retain();
+      addChild(m_rootNode);
+
+      KOMORKI_LOG("CameraPath: playing %s, %zu events against %s from diff %llu",
+                  pathFileName.c_str(),
+                  m_path.m_events.size(),
+                  m_path.m_workingFolder.c_str(),
+                  (unsigned long long)m_path.m_playedDiffs);
+
+      scheduleUpdate();
+      return true;
+    }
+
+    void CameraPathScene::update(float dt)
+    {
+      if (!m_viewport)
+      {
+        if (Seek(dt))
+        {
+          StartPlayback();
+        }
+        return;
+      }
+
+      // the time between frames includes the rendering of the previous one, but not the waiting
+      // for the reader, the disk and the parsing would make the runs of the same path differ
+      auto now = std::chrono::steady_clock::now();
+      if (m_time > 0.f)
+      {
+        std::chrono::duration<float> frameTime = now - m_frameStartTime;
+        m_frameTimes.push_back(std::max(0.f, frameTime.count() - m_frameReaderWaitTime));
+      }
+      m_frameStartTime = now;
+      m_frameReaderWaitTime = 0.f;
+
+      PlayFrame();
+
+      m_maxSpriteBatches = std::max(m_maxSpriteBatches, counters::Get(counters::Counter::SpriteBatches));
+      m_maxQuads = std::max(m_maxQuads, counters::Get(counters::Counter::Quads));
+
+      if (m_nextEvent == m_path.m_events.size())
+      {
+        Report();
+        Finish(EXIT_SUCCESS);
+      }
+    }
+
+    bool CameraPathScene::Seek(float dt)
+    {
+      // the same as the warp, nothing is reported because there are no maps yet
+      auto startTime = std::chrono::steady_clock::now();
+      WorldModelDiffBuckets updates;
+      bool progress = false;
+      while (m_worldModel->m_playedDiffs < m_path.m_playedDiffs)
+      {
+        uint64_t remaining = m_path.m_playedDiffs - m_worldModel->m_playedDiffs;
+        unsigned int numberOfUpdates = static_cast<unsigned int>(std::min<uint64_t>(remaining, config::warpUpdatesPerStep));
+        unsigned int played = m_worldModel->PlayUpdates(numberOfUpdates, Rect(), updates, false);
+        progress = progress || played > 0;
+
+        if (played == 0 || Seconds(startTime) >= config::warpWorkTimePerFrame)
+          break;
+      }
+
+      m_seekIdleTime = progress ? 0.f : m_seekIdleTime + dt;
+      if (m_seekIdleTime >= config::cameraPathReaderTimeout)
+      {
+        KOMORKI_LOG("CameraPath: FAILED the folder has %llu diffs, the path starts at %llu",
+                    (unsigned long long)m_worldModel->m_playedDiffs,
+                    (unsigned long long)m_path.m_playedDiffs);
+        Finish(EXIT_FAILURE);
+        return false;
+      }
+
+      return m_worldModel->m_playedDiffs == m_path.m_playedDiffs;
+    }
+
+    void CameraPathScene::StartPlayback()
+    {
+      m_startChunksCreated = counters::Get(counters::Counter::ChunksCreated);
+
+      m_viewport = std::make_shared<jevo::graphic::Viewport>(m_rootNode, m_path.m_viewSize, m_worldModel);
+      m_viewport->SetCamera(m_path.m_cameraOrigin, m_path.m_cameraScale);
+
+      KOMORKI_LOG("CameraPath: started at diff %llu", (unsigned long long)m_worldModel->m_playedDiffs);
+    }
+
+    void CameraPathScene::PlayFrame()
+    {
+      m_time += config::cameraPathFrameTime;
+
+      const auto& events = m_path.m_events;
+      while (m_nextEvent < events.size() && events[m_nextEvent].time <= m_time)
+      {
+        const CameraPath::Event& event = events[m_nextEvent];
+        switch (event.type)
+        {
+          case CameraPath::EventType::Move:
+            m_viewport->Move(event.point);
+            break;
+          case CameraPath::EventType::Zoom:
+            m_viewport->Zoom(event.point, event.scaleOffset);
+            break;
+          case CameraPath::EventType::Tick:
+            if (!PlayTick(event.diffs))
+            {
+              KOMORKI_LOG("CameraPath: FAILED no diffs for the tick at %.2fs", event.time);
+              Finish(EXIT_FAILURE);
+              return;
+            }
+            break;
+        }
+        m_nextEvent += 1;
+      }
+
+      m_viewport->Calculate(config::cameraPathFrameTime);
+      m_viewport->UpdateFrame(config::cameraPathFrameTime);
+    }
+
+    bool CameraPathScene::PlayTick(unsigned int diffs)
+    {
+      // a recorded tick is a single Viewport::Update, it stops at the same diff when it is played again
+      auto startTime = std::chrono::steady_clock::now();
+      unsigned int remaining = diffs;
+      while (remaining > 0)
+      {
+        unsigned int played = m_viewport->Update(m_path.m_updateTime, remaining);
+        remaining -= std::min(played, remaining);
+        m_playedDiffs += played;
+
+        if (played > 0)
+          continue;
+
+        if (Seconds(startTime) >= config::cameraPathReaderTimeout)
+          return false;
+
+        auto waitStartTime = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        float waitTime = Seconds(waitStartTime);
+        m_frameReaderWaitTime += waitTime;
+        m_readerWaitTime += waitTime;
+      }
+      return true;
+    }
+
+    void CameraPathScene::Report()
+    {
+      std::vector<float> frameTimes = m_frameTimes;
+      std::sort(frameTimes.begin(), frameTimes.end());
+
+      float totalTime = 0.f;
+      for (float time : frameTimes)
+      {
+        totalTime += time;
+      }
+
+      nlohmann::json report;
+      report["frames"] = frameTimes.size();
+      report["diffs"] = m_playedDiffs;
+      report["frameTimeAverage"] = frameTimes.empty() ? 0.f : totalTime / frameTimes.size();
+      report["frameTimeP50"] = Percentile(frameTimes, 0.5f);
+      report["frameTimeP90"] = Percentile(frameTimes, 0.9f);
+      report["frameTimeP99"] = Percentile(frameTimes, 0.99f);
+      report["frameTimeMax"] = frameTimes.empty() ? 0.f : frameTimes.back();
+      report["chunksCreated"] = counters::Get(counters::Counter::ChunksCreated) - m_startChunksCreated;
+      report["maxSpriteBatches"] = m_maxSpriteBatches;
+      report["maxQuads"] = m_maxQuads;
+      report["readerWaitTime"] = m_readerWaitTime; // seconds, not in the frame times
+
+      KOMORKI_LOG("CameraPath: frames: %zu diffs: %llu frame p50: %.2fms p90: %.2fms p99: %.2fms max: %.2fms chunks: %lld batches: %lld quads: %lld reader wait: %.2fs",
+                  frameTimes.size(),
+                  (unsigned long long)m_playedDiffs,
+                  Percentile(frameTimes, 0.5f) * 1000.f,
+                  Percentile(frameTimes, 0.9f) * 1000.f,
+                  Percentile(frameTimes, 0.99f) * 1000.f,
+                  report["frameTimeMax"].get<float>() * 1000.f,
+                  (long long)report["chunksCreated"].get<int64_t>(),
+                  (long long)m_maxSpriteBatches,
+                  (long long)m_maxQuads,
+                  m_readerWaitTime);
+
+      std::string reportFileName = m_pathFileName + ".report.json";
+      std::ofstream o(reportFileName);
+      o << report.dump(1) << std::endl;
+      if (!o.good())
+      {
+        KOMORKI_LOG("CameraPath: failed to write %s", reportFileName.c_str());
+      }
+    }
+
+    void CameraPathScene::Finish(int exitCode)
+    {
+      // the scene and the Director are released by the main loop, main returns the code
+      unscheduleUpdate();
+      if (m_viewport) m_viewport->Destroy();
+      AppDelegate::SetExitCode(exitCode);
+      Director::getInstance()->end();
+    }
+  }
+}
@@ -0,0 +1,84 @@
+//
+//  CameraPathScene.h
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include "Viewport.h"
+#include "CameraPath.h"
+
+namespace jevo
+{
+  class WorldModel;
+
+  namespace ui
+  {
+    // Plays a recorded camera path against its folder. The world is warped to the diff the recording
+    // started at, then every frame advances the path by config::cameraPathFrameTime and applies its
+    // moves, zooms and ticks, so every run sees the same cameras and diffs. The time spent waiting for
+    // the reader is not a part of the frame times. At the end the frame time percentiles, the created chunks
+    // and the sprite and quad counts are logged and written to <path>.report.json, and the application ends.
+    class CameraPathScene: public cocos2d::Layer
+    {
+    public:
+      virtual bool init(const std::string& pathFileName);
+      virtual ~CameraPathScene();
+      static cocos2d::Scene* createScene(const std::string& pathFileName)
+      {
+        auto scene = cocos2d::Scene::create();
+
+        CameraPathScene *pRet = new(std::nothrow) CameraPathScene();
+        if (pRet && pRet->init(pathFileName))
+        {
+          pRet->autorelease();
+          scene->addChild(pRet);
+          return scene;
+        }
+        else
+        {
+          delete pRet;
+          pRet = NULL;
+          return NULL;
+        }
+      }
+
+      virtual void update(float dt) override;
+
+    private:
+
+      // plays the diffs before the start of the path, returns true when all of them are played
+      bool Seek(float dt);
+      void StartPlayback();
+      void PlayFrame();
+      // plays exactly the number of diffs, waits for the reader if it is behind
+      bool PlayTick(unsigned int diffs);
+      void Report();
+      void Finish(int exitCode);
+
+      CameraPath m_path;
+      std::string m_pathFileName;
+      std::shared_ptr<WorldModel> m_worldModel;
+      jevo::graphic::Viewport::Ptr m_viewport;
+      cocos2d::Node* m_rootNode = nullptr;
+
+      float m_time = 0.f; // of the path
+      size_t m_nextEvent = 0;
+      float m_seekIdleTime = 0.f;
+
+      std::vector<float> m_frameTimes; // seconds
+      std::chrono::steady_clock::time_point m_frameStartTime;
+      float m_frameReaderWaitTime = 0.f; // seconds of the current frame spent waiting for the diffs
+      float m_readerWaitTime = 0.f; // of the whole run
+      int64_t m_startChunksCreated = 0;
+      int64_t m_maxSpriteBatches = 0;
+      int64_t m_maxQuads = 0;
+      uint64_t m_playedDiffs = 0;
+    };
+  }
+}
@@ -0,0 +1,104 @@
+//
+//  ChunkTexture.cpp
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#include "ChunkTexture.h"
+
+USING_NS_CC;
+
+namespace jevo
+{
+  namespace graphic
+  {
+    ChunkTexture::ChunkTexture()
+    {
+    }
+    
+    ChunkTexture::~ChunkTexture()
+    {
+    }
+    
+    bool ChunkTexture::init(int width, int height)
+    {
+      m_pixels = std::make_shared<Buffer2D<Color4B>>(width, height);
+      m_pixels->Fill(Color4B(0, 0, 0, 0));
+      
+      auto texture = new (std::nothrow) Texture2D();
+      texture->initWithData(m_pixels->GetData(),
+                            width * height * sizeof(Color4B),
+                            Texture2D::PixelFormat::RGBA8888,
+                            width,
+                            height,
+                            Size(width, height));
+      texture->setAliasTexParameters();
+      
+      bool result = Sprite::initWithTexture(texture);
+      texture->release();
+      
+      if (!result)
+      {
+        return false;
+      }
+      
+      setAnchorPoint({0, 0});
+      // texture rows go from the bottom of the map to the top
+      setFlippedY(true);
+      
+      return true;
+    }
+    
+    void ChunkTexture::SetCell(int x, int y, const Color4B& color)
+    {
+      if (!m_pixels->Set(x, y, color))
+      {
+        return;
+      }
+      
+      if (!m_dirty)
+      {
+        m_dirtyRect = Rect(x, y, 1, 1);
+        m_dirty = true;
+        return;
+      }
+      
+      PixelPos left = std::min(m_dirtyRect.Left(), x);
+      PixelPos bottom = std::min(m_dirtyRect.Bottom(), y);
+      PixelPos right = std::max(m_dirtyRect.Right(), x);
+      PixelPos top = std::max(m_dirtyRect.Top(), y);
+      m_dirtyRect = Rect(left, bottom, right - left + 1, top - bottom + 1);
+    }
+    
+    const Color4B& ChunkTexture::GetCell(int x, int y) const
+    {
+      static const Color4B empty(0, 0, 0, 0);
+      return m_pixels->GetWithDefault(x, y, empty);
+    }
+    
+    void ChunkTexture::Clear()
+    {
+      m_pixels->Fill(Color4B(0, 0, 0, 0));
+      m_dirtyRect = Rect(0, 0, m_pixels->GetWidth(), m_pixels->GetHeight());
+      m_dirty = true;
+    }
+    
+    void ChunkTexture::Flush()
+    {
+      if (!m_dirty)
+      {
+        return;
+      }
+      
+      // a band of full rows is contiguous in memory, so it is uploaded without repacking
+      auto width = m_pixels->GetWidth();
+      getTexture()->updateWithData(m_pixels->GetData() + m_dirtyRect.Bottom() * width,
+                                   0,
+                                   m_dirtyRect.Bottom(),
+                                   width,
+                                   m_dirtyRect.size.y);
+      m_dirty = false;
+    }
+  }
+}
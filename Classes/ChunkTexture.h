@@ -0,0 +1,38 @@
+//
+//  ChunkTexture.h
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#pragma once
+
+#include "cocos2d.h"
+#include "Common.h"
+#include "Buffer2D.h"
+
+namespace jevo
+{
+  namespace graphic
+  {
+    // One texel per cell. Changed cells are collected in a dirty rect and go to the GPU in Flush().
+    class ChunkTexture : public cocos2d::Sprite
+    {
+    public:
+      
+      ChunkTexture();
+      virtual ~ChunkTexture();
+      
+      bool init(int width, int height);
+      void SetCell(int x, int y, const cocos2d::Color4B& color);
+      const cocos2d::Color4B& GetCell(int x, int y) const;
+      void Clear();
+      void Flush();
+      
+    private:
+      std::shared_ptr<Buffer2D<cocos2d::Color4B>> m_pixels;
+      Rect m_dirtyRect;
+      bool m_dirty = false;
+    };
+  }
+}
@@ -0,0 +1,278 @@
+//
+//  ColorPyramid.cpp
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#include "ColorPyramid.h"
+#include "WorldModel.h"
+#include "UIConfig.h"
+#include "Logging.h"
+
+namespace jevo
+{
+  namespace graphic
+  {
+    namespace
+    {
+      cocos2d::Color4B CellColor(const GreatPixel* pixel)
+      {
+        if (pixel && !pixel->IsEmpty())
+        {
+          return cocos2d::Color4B(pixel->GetColor());
+        }
+        return cocos2d::Color4B(config::mapBackground);
+      }
+
+      PixelPos CeilHalf(PixelPos value)
+      {
+        return (value + 1) / 2;
+      }
+    }
+
+    //********************************************************************************************
+    ColorPyramid::ColorPyramid()
+    {
+    }
+
+    //********************************************************************************************
+    ColorPyramid::~ColorPyramid()
+    {
+      for (auto& level : m_levels)
+      {
+        CC_SAFE_RELEASE_NULL(level.texture);
+      }
+    }
+
+    //********************************************************************************************
+    bool ColorPyramid::Init(const WorldModel& worldModel)
+    {
+      Vec2 size = worldModel.GetSize();
+      if (size.x <= 0 || size.y <= 0)
+        return false;
+
+      m_firstLevel = 0;
+      while (std::max(size.x, size.y) > static_cast<PixelPos>(config::pyramidMaxTextureSize))
+      {
+        size = Vec2(CeilHalf(size.x), CeilHalf(size.y));
+        m_firstLevel += 1;
+      }
+
+      while (true)
+      {
+        Level level;
+        level.cellsPerTexel = 1 << (m_firstLevel + m_levels.size());
+        level.colors = std::make_shared<ColorBuffer>(size.x, size.y);
+        level.dirtyMask = std::make_shared<DirtyBuffer>(size.x, size.y);
+        level.dirtyMask->Fill(0);
+        level.dirtyBottom = size.y;
+        level.dirtyTop = -1;
+        m_levels.push_back(level);
+
+        if (size.x == 1 && size.y == 1)
+          break;
+
+        size = Vec2(CeilHalf(size.x), CeilHalf(size.y));
+      }
+
+      for (unsigned int i = 0; i < m_levels.size(); ++i)
+      {
+        Level& level = m_levels[i];
+        if (i == 0)
+        {
+          // texels of the first level only read the world
+          level.colors->ParallelForEach([this, &worldModel](const PixelPos& x, const PixelPos& y, cocos2d::Color4B& value)
+                                        {
+                                          value = CalculateTexel(worldModel, 0, Vec2(x, y));
+                                        });
+        }
+        else
+        {
+          // the same average as CalculateTexel
+          m_levels[i - 1].colors->Downscale(2, *level.colors);
+        }
+
+        auto width = level.colors->GetWidth();
+        auto height = level.colors->GetHeight();
+        level.texture = new (std::nothrow) cocos2d::Texture2D();
+        level.texture->initWithData(level.colors->GetData(),
+                                    width * height * sizeof(cocos2d::Color4B),
+                                    cocos2d::Texture2D::PixelFormat::RGBA8888,
+                                    width,
+                                    height,
+                                    cocos2d::Size(width, height));
+        level.texture->setAliasTexParameters();
+      }
+
+      LOG_W("%s levels: [%u, %u]", __FUNCTION__, GetFirstLevel(), GetLastLevel());
+
+      return true;
+    }
+
+    //********************************************************************************************
+    void ColorPyramid::SetCellDirty(Vec2ConstRef pos)
+    {
+      if (m_levels.empty())
+        return;
+
+      Level& level = m_levels.front();
+      MarkDirty(level, pos / level.cellsPerTexel);
+    }
+
+    //********************************************************************************************
+    void ColorPyramid::Calculate(const WorldModel& worldModel)
+    {
+      for (unsigned int i = 0; i < m_levels.size(); ++i)
+      {
+        Level& level = m_levels[i];
+        if (level.dirty.empty())
+          continue;
+
+        for (const auto& pos : level.dirty)
+        {
+          level.colors->Set(pos.x, pos.y, CalculateTexel(worldModel, i, pos));
+          level.dirtyMask->Set(pos.x, pos.y, 0);
+
+          if (i + 1 < m_levels.size())
+          {
+            MarkDirty(m_levels[i + 1], pos / 2);
+          }
+        }
+
+        level.dirty.clear();
+      }
+    }
+
+    //********************************************************************************************
+    void ColorPyramid::Upload()
+    {
+      for (auto& level : m_levels)
+      {
+        UploadLevel(level);
+      }
+    }
+
+    //********************************************************************************************
+    unsigned int ColorPyramid::GetFirstLevel() const
+    {
+      return m_firstLevel;
+    }
+
+    //********************************************************************************************
+    unsigned int ColorPyramid::GetLastLevel() const
+    {
+      return m_firstLevel + m_levels.size() - 1;
+    }
+
+    //********************************************************************************************
+    unsigned int ColorPyramid::GetLevelForTexelSize(float minTexelSize) const
+    {
+      unsigned int level = m_firstLevel;
+      while (level < GetLastLevel() && static_cast<float>(1 << level) < minTexelSize)
+      {
+        level += 1;
+      }
+      return level;
+    }
+
+    //********************************************************************************************
+    unsigned int ColorPyramid::GetLevelForSize(unsigned int maxSize) const
+    {
+      unsigned int level = m_firstLevel;
+      while (level < GetLastLevel())
+      {
+        Vec2 size = GetLevelSize(level);
+        if (static_cast<unsigned int>(std::max(size.x, size.y)) <= maxSize)
+          break;
+        level += 1;
+      }
+      return level;
+    }
+
+    //********************************************************************************************
+    Vec2 ColorPyramid::GetLevelSize(unsigned int level) const
+    {
+      assert(level >= m_firstLevel && level <= GetLastLevel());
+      const auto& colors = m_levels[level - m_firstLevel].colors;
+      return Vec2(colors->GetWidth(), colors->GetHeight());
+    }
+
+    //********************************************************************************************
+    cocos2d::Texture2D* ColorPyramid::GetTexture(unsigned int level) const
+    {
+      if (level < m_firstLevel || level > GetLastLevel())
+        return nullptr;
+      return m_levels[level - m_firstLevel].texture;
+    }
+
+    //********************************************************************************************
+    cocos2d::Color4B ColorPyramid::CalculateTexel(const WorldModel& worldModel, unsigned int levelIndex, Vec2ConstRef pos) const
+    {
+      unsigned int r = 0, g = 0, b = 0, count = 0;
+
+      if (levelIndex == 0)
+      {
+        PixelPos step = m_levels.front().cellsPerTexel;
+        Vec2 worldSize = worldModel.GetSize();
+        for (PixelPos j = pos.y * step; j < std::min((pos.y + 1) * step, worldSize.y); ++j)
+        {
+          for (PixelPos i = pos.x * step; i < std::min((pos.x + 1) * step, worldSize.x); ++i)
+          {
+            auto color = CellColor(worldModel.GetItem(Vec2(i, j)));
+            r += color.r; g += color.g; b += color.b;
+            count += 1;
+          }
+        }
+      }
+      else
+      {
+        const auto& children = m_levels[levelIndex - 1].colors;
+        for (PixelPos j = pos.y * 2; j < std::min(pos.y * 2 + 2, children->GetHeight()); ++j)
+        {
+          for (PixelPos i = pos.x * 2; i < std::min(pos.x * 2 + 2, children->GetWidth()); ++i)
+          {
+            cocos2d::Color4B color;
+            children->Get(i, j, color);
+            r += color.r; g += color.g; b += color.b;
+            count += 1;
+          }
+        }
+      }
+
+      assert(count);
+      return cocos2d::Color4B(r / count, g / count, b / count, 255);
+    }
+
+    //********************************************************************************************
+    void ColorPyramid::MarkDirty(Level& level, Vec2ConstRef pos)
+    {
+      uint8_t* flag = nullptr;
+      if (!level.dirtyMask->Get(pos.x, pos.y, &flag) || *flag)
+        return;
+
+      *flag = 1;
+      level.dirty.push_back(pos);
+      level.dirtyBottom = std::min(level.dirtyBottom, pos.y);
+      level.dirtyTop = std::max(level.dirtyTop, pos.y);
+    }
+
+    //********************************************************************************************
+    void ColorPyramid::UploadLevel(Level& level)
+    {
+      if (level.dirtyTop < level.dirtyBottom)
+        return;
+
+      // rows are contiguous, so the whole band between the dirty rows goes in one call
+      auto width = level.colors->GetWidth();
+      level.texture->updateWithData(level.colors->GetData() + level.dirtyBottom * width,
+                                    0,
+                                    level.dirtyBottom,
+                                    width,
+                                    level.dirtyTop - level.dirtyBottom + 1);
+
+      level.dirtyBottom = level.colors->GetHeight();
+      level.dirtyTop = -1;
+    }
+  }
+}
@@ -0,0 +1,73 @@
+//
+//  ColorPyramid.h
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "cocos2d.h"
+#include "Common.h"
+#include "Buffer2D.h"
+
+namespace jevo
+{
+  class WorldModel;
+
+  namespace graphic
+  {
+    // Averaged cell colors of the whole world. Level N covers 2^N x 2^N cells per texel.
+    // Only levels that fit into config::pyramidMaxTextureSize are kept, each one has its own texture.
+    class ColorPyramid
+    {
+    public:
+
+      using Ptr = std::shared_ptr<ColorPyramid>;
+
+      ColorPyramid();
+      virtual ~ColorPyramid();
+
+      bool Init(const WorldModel& worldModel);
+      void SetCellDirty(Vec2ConstRef pos);
+      // recalculates dirty texels and uploads them to the textures, call both once per frame.
+      // Calculate doesn't touch the textures and may run on a worker, Upload runs on the main thread
+      void Calculate(const WorldModel& worldModel);
+      void Upload();
+
+      unsigned int GetFirstLevel() const;
+      unsigned int GetLastLevel() const;
+      // the finest level which texel is not smaller than minTexelSize cells
+      unsigned int GetLevelForTexelSize(float minTexelSize) const;
+      // the finest level which fits into maxSize texels
+      unsigned int GetLevelForSize(unsigned int maxSize) const;
+      Vec2 GetLevelSize(unsigned int level) const;
+      cocos2d::Texture2D* GetTexture(unsigned int level) const;
+
+    private:
+
+      using ColorBuffer = Buffer2D<cocos2d::Color4B>;
+      using DirtyBuffer = Buffer2D<uint8_t>;
+
+      struct Level
+      {
+        unsigned int cellsPerTexel;
+        std::shared_ptr<ColorBuffer> colors;
+        std::shared_ptr<DirtyBuffer> dirtyMask;
+        std::vector<Vec2> dirty;
+        PixelPos dirtyBottom;
+        PixelPos dirtyTop;
+        cocos2d::Texture2D* texture = nullptr;
+      };
+
+      cocos2d::Color4B CalculateTexel(const WorldModel& worldModel, unsigned int levelIndex, Vec2ConstRef pos) const;
+      void MarkDirty(Level& level, Vec2ConstRef pos);
+      void UploadLevel(Level& level);
+
+      unsigned int m_firstLevel = 0;
+      std::vector<Level> m_levels;
+    };
+  }
+}
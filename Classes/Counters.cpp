@@ -0,0 +1,133 @@
+//
+//  Counters.cpp
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#include "Counters.h"
+#include "UIConfig.h"
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <ctime>
+
+namespace jevo
+{
+  namespace counters
+  {
+    namespace
+    {
+      const unsigned int kNumberOfCounters = static_cast<unsigned int>(Counter::Count);
+
+      std::atomic<int64_t>& Value(Counter counter)
+      {
+        static std::atomic<int64_t> values[kNumberOfCounters] = {};
+        assert(counter < Counter::Count);
+        return values[static_cast<unsigned int>(counter)];
+      }
+    }
+
+    //********************************************************************************************
+    void Add(Counter counter, int64_t value)
+    {
+      Value(counter).fetch_add(value, std::memory_order_relaxed);
+    }
+
+    //********************************************************************************************
+    void Set(Counter counter, int64_t value)
+    {
+      Value(counter).store(value, std::memory_order_relaxed);
+    }
+
+    //********************************************************************************************
+    int64_t Get(Counter counter)
+    {
+      return Value(counter).load(std::memory_order_relaxed);
+    }
+
+    //********************************************************************************************
+    const char* GetName(Counter counter)
+    {
+      switch (counter)
+      {
+        case Counter::DiffsApplied: return "diffs_applied";
+        case Counter::DiffsFiltered: return "diffs_filtered";
+        case Counter::DiffBacklog: return "diff_backlog";
+        case Counter::PartialMaps: return "partial_maps";
+        case Counter::ChunksCreated: return "chunks_created";
+        case Counter::ChunksDestroyed: return "chunks_destroyed";
+        case Counter::SpriteBatches: return "sprite_batches";
+        case Counter::Quads: return "quads";
+        case Counter::Organizms: return "organizms";
+        case Counter::WorldChunks: return "world_chunks";
+        case Counter::EnergyCells: return "energy_cells";
+        case Counter::SpritePoolHits: return "sprite_pool_hits";
+        case Counter::SpritePoolMisses: return "sprite_pool_misses";
+        case Counter::Count: break;
+      }
+      assert(false);
+      return "";
+    }
+
+    //********************************************************************************************
+    bool Sampler::Init(const std::string& fileName)
+    {
+      m_fileName = fileName;
+      m_timeSinceSample = 0.f;
+      return Open();
+    }
+
+    //********************************************************************************************
+    void Sampler::Update(float dt)
+    {
+      m_timeSinceSample += dt;
+      if (m_timeSinceSample < config::countersSampleInterval)
+        return;
+
+      m_timeSinceSample = 0.f;
+      WriteSample();
+    }
+
+    //********************************************************************************************
+    void Sampler::WriteSample()
+    {
+      if (!m_file.is_open())
+        return;
+
+      if (m_file.tellp() > static_cast<std::streamoff>(config::countersMaxFileSize))
+      {
+        m_file.close();
+        std::string previousFileName = m_fileName + ".1";
+        std::remove(previousFileName.c_str());
+        std::rename(m_fileName.c_str(), previousFileName.c_str());
+        if (!Open())
+          return;
+      }
+
+      // unix time to match the samples with the logs of the simulator
+      m_file << static_cast<int64_t>(std::time(nullptr));
+      for (unsigned int i = 0; i < kNumberOfCounters; ++i)
+      {
+        m_file << "," << Get(static_cast<Counter>(i));
+      }
+      m_file << std::endl;
+    }
+
+    //********************************************************************************************
+    bool Sampler::Open()
+    {
+      m_file.open(m_fileName, std::ios::out | std::ios::trunc);
+      if (!m_file)
+        return false;
+
+      m_file << "time";
+      for (unsigned int i = 0; i < kNumberOfCounters; ++i)
+      {
+        m_file << "," << GetName(static_cast<Counter>(i));
+      }
+      m_file << std::endl;
+      return true;
+    }
+  }
+}
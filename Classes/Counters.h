@@ -0,0 +1,63 @@
+//
+//  Counters.h
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+namespace jevo
+{
+  namespace counters
+  {
+    // Process wide counters, safe to change from any thread.
+    // Totals only grow, gauges go up and down with the number of live objects.
+    enum class Counter
+    {
+      DiffsApplied,      // total
+      DiffsFiltered,     // total, diffs off the loaded and the cached maps, not reported to the maps
+      DiffBacklog,       // gauge, diffs read but not played
+      PartialMaps,       // gauge
+      ChunksCreated,     // total
+      ChunksDestroyed,   // total
+      SpriteBatches,     // gauge
+      Quads,             // gauge, quads of the allocated blocks of the quad layers
+      Organizms,         // gauge
+      WorldChunks,       // gauge, allocated chunks of SparseWorld
+      EnergyCells,       // gauge, cells with the energy flag
+      SpritePoolHits,    // total
+      SpritePoolMisses,  // total
+      Count
+    };
+
+    void Add(Counter counter, int64_t value = 1);
+    void Set(Counter counter, int64_t value);
+    int64_t Get(Counter counter);
+    const char* GetName(Counter counter);
+
+    // Writes all counters to a CSV file every config::countersSampleInterval seconds.
+    // When the file is bigger than config::countersMaxFileSize it is moved to <fileName>.1 and started again.
+    class Sampler
+    {
+    public:
+
+      bool Init(const std::string& fileName);
+      // call it every frame
+      void Update(float dt);
+      void WriteSample();
+
+    private:
+
+      bool Open();
+
+      std::string m_fileName;
+      std::ofstream m_file;
+      float m_timeSinceSample = 0.f;
+    };
+  }
+}
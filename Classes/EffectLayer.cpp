@@ -0,0 +1,186 @@
+//
+//  EffectLayer.cpp
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#include "EffectLayer.h"
+#include "UIConfig.h"
+#include "JobSystem.h"
+#include <atomic>
+
+USING_NS_CC;
+
+namespace jevo
+{
+  namespace graphic
+  {
+    bool EffectLayer::init(const std::string& textureFileName, unsigned int effectsPerBlock, unsigned int cellsPerBlock, float quadSize)
+    {
+      m_cellsPerBlock = cellsPerBlock;
+      return QuadLayer::init(textureFileName, effectsPerBlock, quadSize);
+    }
+
+    QuadLayer::BlockId EffectLayer::AllocateBlock()
+    {
+      BlockId block = QuadLayer::AllocateBlock();
+
+      if (block >= static_cast<BlockId>(m_rings.size()))
+      {
+        m_rings.resize(block + 1);
+        unsigned int quads = m_rings.size() * GetQuadsPerBlock();
+        m_effectKeys.resize(quads, -1);
+        m_startTime.resize(quads, 0.f);
+        m_duration.resize(quads, 0.f);
+        m_opacity.resize(quads, 0);
+        m_colors.resize(quads);
+      }
+
+      Ring& ring = m_rings[block];
+      ring.head = 0;
+      ring.live = 0;
+      ring.cellEffects.assign(m_cellsPerBlock * static_cast<unsigned int>(Type::Count), -1);
+
+      return block;
+    }
+
+    void EffectLayer::ReleaseBlock(BlockId block)
+    {
+      Ring& ring = m_rings[block];
+      for (unsigned int slot = 0; slot < GetQuadsPerBlock() && ring.live > 0; ++slot)
+      {
+        if (m_effectKeys[GetQuadIndex(block, slot)] >= 0)
+        {
+          RemoveEffect(block, slot);
+        }
+      }
+
+      ring.cellEffects.clear();
+      QuadLayer::ReleaseBlock(block);
+    }
+
+    void EffectLayer::AddEffect(BlockId block,
+                                unsigned int cell,
+                                const cocos2d::Vec2& center,
+                                Type type,
+                                const Color3B& color,
+                                uint8_t opacity,
+                                float scale,
+                                float duration)
+    {
+      assert(cell < m_cellsPerBlock);
+
+      Ring& ring = m_rings[block];
+      int key = static_cast<int>(type) * m_cellsPerBlock + cell;
+      int slot = ring.cellEffects[key];
+
+      if (slot < 0)
+      {
+        slot = ring.head;
+        // the ring is full when the head is live, the oldest slot goes first. A free slot needs
+        // the budget, the head stays on it when the effect is dropped
+        bool full = m_effectKeys[GetQuadIndex(block, slot)] >= 0;
+        if (!full && m_liveEffects >= config::effectsBudget)
+          return;
+
+        ring.head = (ring.head + 1) % GetQuadsPerBlock();
+        if (full)
+        {
+          RemoveEffect(block, slot);
+        }
+
+        ring.cellEffects[key] = slot;
+        ring.live += 1;
+        m_liveEffects += 1;
+      }
+
+      unsigned int quad = GetQuadIndex(block, slot);
+      m_effectKeys[quad] = key;
+      m_startTime[quad] = GetTime();
+      m_duration[quad] = duration;
+      m_opacity[quad] = opacity;
+      m_colors[quad] = color;
+
+      float alpha = opacity / 255.f;
+      SetQuad(block, slot, center, Color4B(color.r * alpha, color.g * alpha, color.b * alpha, opacity), scale);
+    }
+
+    unsigned int EffectLayer::GetNumberOfEffects() const
+    {
+      return m_liveEffects;
+    }
+
+    void EffectLayer::update(float dt)
+    {
+      QuadLayer::update(dt);
+
+      float time = GetTime();
+      if (m_liveEffects < config::effectsPerMap)
+      {
+        for (unsigned int block = 0; block < m_rings.size(); ++block)
+        {
+          m_liveEffects -= FadeBlock(block, time);
+        }
+        return;
+      }
+
+      // blocks are faded on the workers, they share only the number of the live effects
+      std::atomic<unsigned int> finished(0);
+      JobSystem::GetShared().ParallelFor(m_rings.size(), [this, time, &finished](size_t block)
+                                         {
+                                           finished += FadeBlock(static_cast<BlockId>(block), time);
+                                         });
+      m_liveEffects -= finished;
+    }
+
+    unsigned int EffectLayer::FadeBlock(BlockId block, float time)
+    {
+      if (m_rings[block].live == 0)
+        return 0;
+
+      unsigned int finished = 0;
+      for (unsigned int slot = 0; slot < GetQuadsPerBlock(); ++slot)
+      {
+        unsigned int quad = GetQuadIndex(block, slot);
+        if (m_effectKeys[quad] < 0)
+          continue;
+
+        float t = (time - m_startTime[quad]) / m_duration[quad];
+        if (t >= 1.f)
+        {
+          ReleaseSlot(block, slot);
+          finished += 1;
+          continue;
+        }
+
+        // the blend function expects premultiplied colors
+        float alpha = m_opacity[quad] * (1.f - t) / 255.f;
+        const Color3B& color = m_colors[quad];
+        SetQuadColor(block, slot, Color4B(color.r * alpha, color.g * alpha, color.b * alpha, alpha * 255.f));
+      }
+      return finished;
+    }
+
+    void EffectLayer::RemoveEffect(BlockId block, unsigned int slot)
+    {
+      ReleaseSlot(block, slot);
+      m_liveEffects -= 1;
+    }
+
+    void EffectLayer::ReleaseSlot(BlockId block, unsigned int slot)
+    {
+      unsigned int quad = GetQuadIndex(block, slot);
+      int key = m_effectKeys[quad];
+      assert(key >= 0);
+
+      Ring& ring = m_rings[block];
+      ring.cellEffects[key] = -1;
+      ring.live -= 1;
+      m_effectKeys[quad] = -1;
+
+      // effects have no tweens, clearing the quad touches only the block
+      PrepareClearQuad(block, slot);
+    }
+  }
+}
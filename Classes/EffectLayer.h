@@ -0,0 +1,78 @@
+//
+//  EffectLayer.h
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#pragma once
+
+#include <vector>
+#include "QuadLayer.h"
+
+namespace jevo
+{
+  namespace graphic
+  {
+    // Fading cell effects (fades and alerts). A block is a fixed-capacity ring buffer of a map,
+    // the oldest effect of the map is overwritten when the ring is full. An effect restarts
+    // instead of stacking when the cell already has one of the same type, the total number of
+    // effects is limited by config::effectsBudget. All effects are faded in one pass per frame.
+    class EffectLayer : public QuadLayer
+    {
+    public:
+
+      enum class Type
+      {
+        Fade,
+        Alert,
+        Count
+      };
+
+      bool init(const std::string& textureFileName, unsigned int effectsPerBlock, unsigned int cellsPerBlock, float quadSize);
+
+      virtual BlockId AllocateBlock() override;
+      virtual void ReleaseBlock(BlockId block) override;
+
+      void AddEffect(BlockId block,
+                     unsigned int cell,
+                     const cocos2d::Vec2& center,
+                     Type type,
+                     const cocos2d::Color3B& color,
+                     uint8_t opacity,
+                     float scale,
+                     float duration);
+      unsigned int GetNumberOfEffects() const;
+
+      virtual void update(float dt) override;
+
+    private:
+
+      struct Ring
+      {
+        unsigned int head = 0; // next slot to write
+        unsigned int live = 0;
+        std::vector<int> cellEffects; // slot of the effect for a (type, cell) or -1
+      };
+
+      void RemoveEffect(BlockId block, unsigned int slot);
+      // fades the effects of the block, returns the number of the finished ones.
+      // Safe for different blocks at the same time, m_liveEffects is left to the caller
+      unsigned int FadeBlock(BlockId block, float time);
+      // frees the slot of the ring without changing m_liveEffects
+      void ReleaseSlot(BlockId block, unsigned int slot);
+
+      unsigned int m_cellsPerBlock = 0;
+      std::vector<Ring> m_rings;
+
+      // per quad
+      std::vector<int> m_effectKeys; // index in Ring::cellEffects or -1 for a free slot
+      std::vector<float> m_startTime;
+      std::vector<float> m_duration;
+      std::vector<uint8_t> m_opacity;
+      std::vector<cocos2d::Color3B> m_colors;
+
+      unsigned int m_liveEffects = 0;
+    };
+  }
+}
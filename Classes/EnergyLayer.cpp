@@ -0,0 +1,98 @@
+//
+//  EnergyLayer.cpp
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#include "EnergyLayer.h"
+#include "ChunkTexture.h"
+#include "UIConfig.h"
+#include <algorithm>
+#include <cmath>
+
+USING_NS_CC;
+
+namespace jevo
+{
+  namespace graphic
+  {
+    bool EnergyLayer::init(int width, int height)
+    {
+      if (!Node::init())
+      {
+        return false;
+      }
+      
+      m_width = width;
+      
+      m_energy = new ChunkTexture(); m_energy->autorelease();
+      if (!m_energy->init(width, height))
+      {
+        return false;
+      }
+      addChild(m_energy, 0);
+      
+      m_alerts = new ChunkTexture(); m_alerts->autorelease();
+      if (!m_alerts->init(width, height))
+      {
+        return false;
+      }
+      addChild(m_alerts, 1);
+      
+      scheduleUpdate();
+      
+      return true;
+    }
+    
+    void EnergyLayer::SetEnergy(int x, int y, const Color3B& color)
+    {
+      m_energy->SetCell(x, y, Color4B(color));
+    }
+    
+    void EnergyLayer::ClearEnergy(int x, int y)
+    {
+      m_energy->SetCell(x, y, Color4B(0, 0, 0, 0));
+    }
+    
+    void EnergyLayer::Alert(int x, int y, const Color3B& color)
+    {
+      // a live alert restarts with the new color
+      if (m_alerts->GetCell(x, y).a == 0)
+      {
+        m_liveAlerts.push_back(x + y * m_width);
+      }
+      m_alerts->SetCell(x, y, Color4B(color.r, color.g, color.b, config::alertInitialOpacity));
+    }
+    
+    void EnergyLayer::update(float dt)
+    {
+      m_timeSinceStep += dt;
+      if (m_timeSinceStep < config::energyAlertStep || m_liveAlerts.empty())
+        return;
+      
+      float steps = std::floor(m_timeSinceStep / config::energyAlertStep);
+      m_timeSinceStep -= steps * config::energyAlertStep;
+      
+      int fade = std::max(1, static_cast<int>(config::alertInitialOpacity * steps * config::energyAlertStep / config::alertDuration));
+      
+      auto it = std::remove_if(m_liveAlerts.begin(), m_liveAlerts.end(), [this, fade](unsigned int cell)
+                               {
+                                 int x = cell % m_width;
+                                 int y = cell / m_width;
+                                 Color4B color = m_alerts->GetCell(x, y);
+                                 color.a = static_cast<GLubyte>(std::max(0, color.a - fade));
+                                 m_alerts->SetCell(x, y, color);
+                                 return color.a == 0;
+                               });
+      m_liveAlerts.erase(it, m_liveAlerts.end());
+    }
+    
+    void EnergyLayer::visit(Renderer *renderer, const Mat4& parentTransform, uint32_t parentFlags)
+    {
+      m_energy->Flush();
+      m_alerts->Flush();
+      Node::visit(renderer, parentTransform, parentFlags);
+    }
+  }
+}
@@ -0,0 +1,45 @@
+//
+//  EnergyLayer.h
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#pragma once
+
+#include <vector>
+#include "cocos2d.h"
+
+namespace jevo
+{
+  namespace graphic
+  {
+    class ChunkTexture;
+    
+    // The energy cells of a map in RenderMode::Sprites, a texel per cell instead of a quad.
+    // Alerts of the energy are texels of a second texture, all of them are faded together
+    // every config::energyAlertStep and the changed textures are uploaded once before drawing.
+    class EnergyLayer : public cocos2d::Node
+    {
+    public:
+      
+      bool init(int width, int height);
+      
+      // cells are in the map coordinates
+      void SetEnergy(int x, int y, const cocos2d::Color3B& color);
+      void ClearEnergy(int x, int y);
+      void Alert(int x, int y, const cocos2d::Color3B& color);
+      
+      virtual void update(float dt) override;
+      virtual void visit(cocos2d::Renderer *renderer, const cocos2d::Mat4& parentTransform, uint32_t parentFlags) override;
+      
+    private:
+      
+      ChunkTexture* m_energy = nullptr;
+      ChunkTexture* m_alerts = nullptr;
+      std::vector<unsigned int> m_liveAlerts; // x + y * m_width
+      int m_width = 0;
+      float m_timeSinceStep = 0.f;
+    };
+  }
+}
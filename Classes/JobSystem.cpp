@@ -0,0 +1,340 @@
+//
+//  JobSystem.cpp
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#include "JobSystem.h"
+#include "UIConfig.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cassert>
+
+namespace jevo
+{
+  namespace
+  {
+    // queue of the current worker, only workers of the shared system run jobs in practice
+    thread_local const JobSystem* t_jobSystem = nullptr;
+    thread_local unsigned int t_queue = 0;
+  }
+
+  //********************************************************************************************
+  JobSystem::JobSystem(unsigned int numberOfWorkers)
+  : m_queuedJobs(0)
+  , m_queuedBackgroundJobs(0)
+  {
+    for (unsigned int i = 0; i <= numberOfWorkers; ++i)
+    {
+      m_queues.emplace_back(new Queue());
+    }
+
+    for (unsigned int i = 0; i < numberOfWorkers; ++i)
+    {
+      m_threads.emplace_back(&JobSystem::WorkerThread, this, i);
+    }
+  }
+
+  //********************************************************************************************
+  JobSystem::~JobSystem()
+  {
+    {
+      std::lock_guard<std::mutex> lk(m_sleepLock);
+      m_shouldStop = true;
+    }
+    m_wakeUp.notify_all();
+
+    for (auto& thread : m_threads)
+    {
+      thread.join();
+    }
+  }
+
+  //********************************************************************************************
+  JobSystem& JobSystem::GetShared()
+  {
+    // the reader of the diffs keeps a worker busy for a while, so there is always one
+    static JobSystem jobSystem(config::jobWorkers > 0 ?
+                               config::jobWorkers :
+                               std::max(2u, std::thread::hardware_concurrency()) - 1);
+    return jobSystem;
+  }
+
+  //********************************************************************************************
+  unsigned int JobSystem::GetNumberOfWorkers() const
+  {
+    return m_threads.size();
+  }
+
+  //********************************************************************************************
+  JobSystem::JobPtr JobSystem::Schedule(Task task, const std::vector<JobPtr>& dependencies)
+  {
+    auto job = std::make_shared<Job>();
+    job->m_task = std::move(task);
+    job->m_finished = false;
+    // holds the job until all the dependencies are registered
+    job->m_pending = 1;
+
+    for (const auto& dependency : dependencies)
+    {
+      std::lock_guard<std::mutex> lk(dependency->m_lock);
+      if (dependency->m_finished)
+        continue;
+
+      job->m_pending += 1;
+      dependency->m_dependents.push_back(job);
+    }
+
+    if (--job->m_pending == 0)
+    {
+      Enqueue(job);
+    }
+
+    return job;
+  }
+
+  //********************************************************************************************
+  JobSystem::JobPtr JobSystem::ScheduleBackground(Task task)
+  {
+    assert(!m_threads.empty());
+
+    auto job = std::make_shared<Job>();
+    job->m_task = std::move(task);
+    job->m_background = true;
+    job->m_finished = false;
+    job->m_pending = 0;
+    Enqueue(job);
+    return job;
+  }
+
+  //********************************************************************************************
+  void JobSystem::Wait(const JobPtr& job)
+  {
+    unsigned int queue = GetCurrentQueue();
+    while (!job->m_finished)
+    {
+      // a background job would block the waiting thread for too long
+      JobPtr other = FindJob(queue, false);
+      if (other)
+      {
+        Run(other);
+        continue;
+      }
+
+      // the job runs on a worker or waits for its dependencies, sleep until it is finished
+      // or until there is another job to run
+      std::unique_lock<std::mutex> lk(m_sleepLock);
+      m_waiterWakeUp.wait(lk, [this, &job]
+                          {
+                            return job->m_finished || m_queuedJobs > m_queuedBackgroundJobs;
+                          });
+    }
+  }
+
+  //********************************************************************************************
+  void JobSystem::ParallelFor(size_t count, const std::function<void(size_t)>& task)
+  {
+    if (m_threads.empty() || count < 2)
+    {
+      for (size_t i = 0; i < count; ++i)
+      {
+        task(i);
+      }
+      return;
+    }
+
+    // a job per thread, the jobs take the indices one by one
+    std::atomic<size_t> next(0);
+    auto runTasks = [&next, count, &task]()
+    {
+      for (size_t i = next++; i < count; i = next++)
+      {
+        task(i);
+      }
+    };
+
+    size_t numberOfJobs = std::min<size_t>(count, m_threads.size() + 1);
+    std::vector<JobPtr> jobs;
+    jobs.reserve(numberOfJobs);
+    for (size_t i = 0; i < numberOfJobs; ++i)
+    {
+      jobs.push_back(Schedule(runTasks));
+    }
+
+    for (const auto& job : jobs)
+    {
+      Wait(job);
+    }
+  }
+
+  //********************************************************************************************
+  void JobSystem::WorkerThread(unsigned int index)
+  {
+    PROFILE_THREAD_NAME("JobSystem");
+    t_jobSystem = this;
+    t_queue = index;
+
+    while (true)
+    {
+      JobPtr job = FindJob(index, true);
+      if (job)
+      {
+        Run(job);
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lk(m_sleepLock);
+      m_wakeUp.wait(lk, [this]
+                    {
+                      return m_queuedJobs > 0 || m_shouldStop;
+                    });
+
+      if (m_shouldStop)
+      {
+        return;
+      }
+    }
+  }
+
+  //********************************************************************************************
+  void JobSystem::Enqueue(const JobPtr& job)
+  {
+    Queue& queue = job->m_background ? m_backgroundQueue : *m_queues[GetCurrentQueue()];
+    {
+      std::lock_guard<std::mutex> lk(queue.lock);
+      queue.jobs.push_back(job);
+    }
+
+    {
+      std::lock_guard<std::mutex> lk(m_sleepLock);
+      m_queuedJobs += 1;
+      if (job->m_background)
+      {
+        m_queuedBackgroundJobs += 1;
+      }
+    }
+    m_wakeUp.notify_one();
+    if (!job->m_background)
+    {
+      m_waiterWakeUp.notify_all();
+    }
+  }
+
+  //********************************************************************************************
+  JobSystem::JobPtr JobSystem::FindJob(unsigned int queue, bool background)
+  {
+    if (m_queuedJobs == 0)
+      return nullptr;
+
+    // the newest own job, its data is likely still in the cache
+    JobPtr job = Pop(*m_queues[queue], true);
+    if (job)
+      return job;
+
+    // the oldest job of another queue
+    for (unsigned int i = 1; i < m_queues.size(); ++i)
+    {
+      job = Pop(*m_queues[(queue + i) % m_queues.size()], false);
+      if (job)
+        return job;
+    }
+
+    return background ? Pop(m_backgroundQueue, false) : nullptr;
+  }
+
+  //********************************************************************************************
+  JobSystem::JobPtr JobSystem::Pop(Queue& queue, bool newest)
+  {
+    std::lock_guard<std::mutex> lk(queue.lock);
+    if (queue.jobs.empty())
+      return nullptr;
+
+    JobPtr job;
+    if (newest)
+    {
+      job = std::move(queue.jobs.back());
+      queue.jobs.pop_back();
+    }
+    else
+    {
+      job = std::move(queue.jobs.front());
+      queue.jobs.pop_front();
+    }
+    m_queuedJobs -= 1;
+    if (&queue == &m_backgroundQueue)
+    {
+      m_queuedBackgroundJobs -= 1;
+    }
+    return job;
+  }
+
+  //********************************************************************************************
+  void JobSystem::Run(const JobPtr& job)
+  {
+    job->m_task();
+    job->m_task = nullptr;
+
+    std::vector<JobPtr> dependents;
+    {
+      std::lock_guard<std::mutex> lk(job->m_lock);
+      // the waiting threads check the flag under the sleep lock, so none of them misses the notification
+      std::lock_guard<std::mutex> sleepLk(m_sleepLock);
+      job->m_finished = true;
+      dependents.swap(job->m_dependents);
+    }
+    m_waiterWakeUp.notify_all();
+
+    for (const auto& dependent : dependents)
+    {
+      if (--dependent->m_pending == 0)
+      {
+        Enqueue(dependent);
+      }
+    }
+  }
+
+  //********************************************************************************************
+  unsigned int JobSystem::GetCurrentQueue() const
+  {
+    if (t_jobSystem == this)
+      return t_queue;
+
+    return m_queues.size() - 1;
+  }
+
+  //********************************************************************************************
+  JobGraph::JobGraph(JobSystem& jobSystem)
+  : m_jobSystem(jobSystem)
+  {
+  }
+
+  //********************************************************************************************
+  JobGraph::~JobGraph()
+  {
+    Wait();
+  }
+
+  //********************************************************************************************
+  JobSystem::JobPtr JobGraph::Add(JobSystem::Task task, const std::vector<JobSystem::JobPtr>& dependencies)
+  {
+    m_jobs.push_back(m_jobSystem.Schedule(std::move(task), dependencies));
+    return m_jobs.back();
+  }
+
+  //********************************************************************************************
+  void JobGraph::Wait(const JobSystem::JobPtr& job)
+  {
+    m_jobSystem.Wait(job);
+  }
+
+  //********************************************************************************************
+  void JobGraph::Wait()
+  {
+    for (const auto& job : m_jobs)
+    {
+      m_jobSystem.Wait(job);
+    }
+    m_jobs.clear();
+  }
+}
@@ -0,0 +1,115 @@
+//
+//  JobSystem.h
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace jevo
+{
+  // Jobs of the whole program on a fixed set of workers, config::jobWorkers of them.
+  // Every worker has its own queue: it runs its newest jobs first and steals the oldest jobs
+  // of the other queues when its own is empty. Jobs scheduled from other threads (the main one)
+  // go to a shared queue which every worker steals from.
+  // A job starts after all its dependencies are finished. A thread waiting for a job runs
+  // other jobs meanwhile, so waiting on the main thread doesn't leave a core idle.
+  // Background jobs (e.g. reading files) are run only by the workers, a frame never waits for them.
+  class JobSystem
+  {
+  public:
+
+    using Task = std::function<void()>;
+
+    class Job
+    {
+    public:
+      bool IsFinished() const { return m_finished; }
+
+    private:
+      friend class JobSystem;
+
+      Task m_task;
+      bool m_background = false;
+      std::atomic<int> m_pending; // unfinished dependencies plus one while it is scheduled
+      std::atomic<bool> m_finished;
+      std::mutex m_lock;
+      std::vector<std::shared_ptr<Job>> m_dependents;
+    };
+
+    using JobPtr = std::shared_ptr<Job>;
+
+    explicit JobSystem(unsigned int numberOfWorkers);
+    ~JobSystem();
+
+    static JobSystem& GetShared();
+
+    unsigned int GetNumberOfWorkers() const;
+    // the job is queued when all the dependencies are finished
+    JobPtr Schedule(Task task, const std::vector<JobPtr>& dependencies = {});
+    JobPtr ScheduleBackground(Task task);
+    // runs other jobs until the job is finished, sleeps while there are none
+    void Wait(const JobPtr& job);
+    // calls task(i) for every i in [0, count) on the workers and the calling thread and waits for them,
+    // the order and the threads are arbitrary
+    void ParallelFor(size_t count, const std::function<void(size_t)>& task);
+
+  private:
+
+    struct Queue
+    {
+      std::mutex lock;
+      std::deque<JobPtr> jobs;
+    };
+
+    void WorkerThread(unsigned int index);
+    void Enqueue(const JobPtr& job);
+    // own jobs first, stolen ones otherwise, nullptr if all the queues are empty
+    JobPtr FindJob(unsigned int queue, bool background);
+    JobPtr Pop(Queue& queue, bool newest);
+    void Run(const JobPtr& job);
+    unsigned int GetCurrentQueue() const;
+
+    std::vector<std::thread> m_threads;
+    // a queue per worker and the last one for the other threads
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    Queue m_backgroundQueue;
+    std::atomic<int> m_queuedJobs;
+    std::atomic<int> m_queuedBackgroundJobs;
+    std::mutex m_sleepLock;
+    std::condition_variable m_wakeUp;
+    // threads in Wait, notified when a job is finished or a job they can run is queued
+    std::condition_variable m_waiterWakeUp;
+    bool m_shouldStop = false;
+  };
+
+  // Jobs of a frame, e.g. applying the diffs and preparing the maps after that.
+  // The graph waits for all its jobs when it is destroyed.
+  class JobGraph
+  {
+  public:
+
+    explicit JobGraph(JobSystem& jobSystem = JobSystem::GetShared());
+    ~JobGraph();
+
+    JobSystem::JobPtr Add(JobSystem::Task task, const std::vector<JobSystem::JobPtr>& dependencies = {});
+    void Wait(const JobSystem::JobPtr& job);
+    // waits for all the jobs of the graph
+    void Wait();
+
+  private:
+
+    JobSystem& m_jobSystem;
+    std::vector<JobSystem::JobPtr> m_jobs;
+  };
+}
@@ -4,8 +4,12 @@
 #include "cocos2d/cocos/ui/CocosGUI.h"
 #include "LoadingScene.h"
 #include "UIConfig.h"
+#include "Profiler.h"
+#include "Logging.h"
+#include <chrono>
 
 static const float kZoomStep = 0.05;
+static const float kMinimapMargin = 10.f;
 
 static float kButtonScale = 1.f;
 static float kButtonSize = 40.f;
@@ -14,6 +18,11 @@ static float kViewportUpdateTime = 0.1;
 USING_NS_CC;
 using namespace cocostudio;
 
+MainScene::~MainScene()
+{
+  StopRenderProfiling();
+}
+
 void MainScene::CreateMap(const jevo::graphic::Viewport::Ptr& viewport)
 {
   m_viewport = viewport;
@@ -37,7 +46,12 @@ bool MainScene::init(const jevo::graphic::Viewport::Ptr& viewport)
 
   m_stopManager = false;
   m_updateTime = jevo::config::updateTime;
+  m_pacing.SetTickTime(m_updateTime);
+  m_countersSampler.Init(FileUtils::getInstance()->getWritablePath() + jevo::config::countersFileName);
   m_pause = false;
+  m_renderStartTime = 0;
+  m_afterVisitListener = nullptr;
+  m_afterDrawListener = nullptr;
 
   Size visibleSize = Director::getInstance()->getVisibleSize();
 
@@ -63,7 +77,8 @@ bool MainScene::init(const jevo::graphic::Viewport::Ptr& viewport)
 
   CreateMap(viewport);
 
-  schedule(schedule_selector(MainScene::timerForUpdate), m_updateTime, kRepeatForever, m_updateTime);
+  scheduleUpdate();
+  StartRenderProfiling();
   schedule(schedule_selector(MainScene::timerForViewportUpdate), kViewportUpdateTime, kRepeatForever, kViewportUpdateTime);
 
 #if CC_TARGET_PLATFORM != CC_PLATFORM_IOS
@@ -132,7 +147,7 @@ bool MainScene::init(const jevo::graphic::Viewport::Ptr& viewport)
     float cursorX = mouseEvent->getCursorX();
     float cursorY = mouseEvent->getCursorY();
 
-    if (m_viewport) m_viewport->Zoom({cursorX, cursorY}, scrollY);
+    this->Zoom({cursorX, cursorY}, scrollY);
   };
 
   mouseListener->onMouseMove = [this](Event* event) {
@@ -158,6 +173,18 @@ bool MainScene::init(const jevo::graphic::Viewport::Ptr& viewport)
     {
       this->Exit();
     }
+#ifdef KOMORKI_PROFILER_ENABLED
+    else if (keyCode == EventKeyboard::KeyCode::KEY_P)
+    {
+      std::string fileName = FileUtils::getInstance()->getWritablePath() + jevo::config::profilerTraceFileName;
+      bool result = jevo::profiler::WriteTrace(fileName);
+      KOMORKI_LOG("Profiler trace %s: %s", result ? "saved" : "failed", fileName.c_str());
+    }
+#endif
+    else if (keyCode == EventKeyboard::KeyCode::KEY_R)
+    {
+      this->ToggleCameraRecording();
+    }
   };
 
   keyboardListener->onKeyPressed = [this](EventKeyboard::KeyCode keyCode, Event* event)
@@ -190,6 +217,10 @@ bool MainScene::init(const jevo::graphic::Viewport::Ptr& viewport)
   m_speedToolbar->setPosition(Vec2(origin.x + visibleSize.width,
                                    origin.y));
   m_speedToolbar->setVisible(false);
+  
+  CreateMinimap();
+  m_minimapNode->setPosition(origin + Vec2(kMinimapMargin, kMinimapMargin));
+  UpdateMinimap();
 
   return true;
 }
@@ -239,6 +270,8 @@ void MainScene::ShowMainScreen()
 
 void MainScene::visit(cocos2d::Renderer *renderer, const cocos2d::Mat4 &parentTransform, uint32_t parentFlags)
 {
+  PROFILE_ZONE("MainScene::visit");
+
   Size viewSize = Director::getInstance()->getVisibleSize();
   Size contentSize = getContentSize();
 
@@ -252,6 +285,7 @@ void MainScene::visit(cocos2d::Renderer *renderer, const cocos2d::Mat4 &parentTr
     m_speedToolbar->setPosition(Vec2(origin.x + visibleSize.width,
                                      origin.y));
     m_menuButton->setPosition(Vec2(kButtonSize/2.f, visibleSize.height - kButtonSize/2.f));
+    m_minimapNode->setPosition(origin + Vec2(kMinimapMargin, kMinimapMargin));
     if (m_currenMenu) m_currenMenu->Resize(visibleSize);
 
     if (m_viewport) m_viewport->Resize(visibleSize);
@@ -266,7 +300,15 @@ void MainScene::visit(cocos2d::Renderer *renderer, const cocos2d::Mat4 &parentTr
   Layer::visit(renderer, parentTransform, parentFlags);
 }
 
-void MainScene::timerForUpdate(float dt)
+void MainScene::update(float dt)
+{
+  if (m_viewport) m_viewport->UpdateFrame(dt);
+  UpdateSimulation(dt);
+  m_countersSampler.Update(dt);
+  if (m_cameraRecording) m_cameraRecording->Update(dt);
+}
+
+void MainScene::UpdateSimulation(float dt)
 {
   if (m_pause || m_speed == eSpeedPause) return;
 
@@ -285,24 +327,28 @@ void MainScene::timerForUpdate(float dt)
     return;
   }
 
+  if (!m_viewport) return;
+
   if (m_speed == eSpeedNormal || m_speed == eSpeedDouble)
   {
-    float updateTime = m_speed == eSpeedNormal ? m_updateTime : m_updateTime * 0.2;
-    float updateTimeEstimated = updateTime;
-    float tmp;
-    if (m_viewport) m_viewport->Update(m_updateTime, tmp);
+    // the double speed plays ticks five times more often
+    float speed = m_speed == eSpeedNormal ? 1.f : 5.f;
+    m_pacing.BeginFrame(dt, speed, m_viewport->GetBacklog());
 
-    if (updateTimeEstimated > updateTime)
+    while (m_pacing.NextTick())
     {
-      updateTimeEstimated = 0.f;
+      auto startTime = std::chrono::steady_clock::now();
+      unsigned int playedDiffs = m_viewport->Update(m_updateTime, m_pacing.GetUpdatesPerTick());
+      std::chrono::duration<float> workTime = std::chrono::steady_clock::now() - startTime;
+      m_pacing.EndTick(workTime.count(), playedDiffs);
+      if (m_cameraRecording) m_cameraRecording->RecordTick(playedDiffs);
     }
-    schedule(schedule_selector(MainScene::timerForUpdate), updateTimeEstimated, kRepeatForever, updateTimeEstimated);
   }
   else if (m_speed == eSpeedMax)
   {
-    float updateTimeEstimated = m_updateTime;
-    if (m_viewport) m_viewport->UpdateAsync(updateTimeEstimated);
-    schedule(schedule_selector(MainScene::timerForUpdate), 0, kRepeatForever, 0);
+    unsigned int playedDiffs = m_viewport->UpdateAsync(dt);
+    // played back as a normal tick, the maps get the diffs instead of the syncs
+    if (m_cameraRecording) m_cameraRecording->RecordTick(playedDiffs);
   }
 
   m_prevSpeed = m_speed;
@@ -310,7 +356,8 @@ void MainScene::timerForUpdate(float dt)
 
 void MainScene::timerForViewportUpdate(float dt)
 {
-  if (m_viewport) m_viewport->Calculate();
+  if (m_viewport) m_viewport->Calculate(dt);
+  UpdateMinimap();
 }
 
 void MainScene::Zoom(float direction)
@@ -319,7 +366,14 @@ void MainScene::Zoom(float direction)
   float cursorX = visibleSize.width/2;
   float cursorY = visibleSize.height/2;
 
-  if (m_viewport) m_viewport->Zoom({cursorX, cursorY}, direction);
+  Zoom({cursorX, cursorY}, direction);
+}
+
+void MainScene::Zoom(const Vec2& point, float scaleOffset)
+{
+  if (!m_viewport) return;
+  m_viewport->Zoom(point, scaleOffset);
+  if (m_cameraRecording) m_cameraRecording->RecordZoom(point, scaleOffset);
 }
 
 void MainScene::ZoomIn()
@@ -334,7 +388,34 @@ void MainScene::ZoomOut()
 
 void MainScene::Move(const Vec2& direction, float animationDuration)
 {
-  if (m_viewport) m_viewport->Move(direction);
+  if (!m_viewport) return;
+  m_viewport->Move(direction);
+  if (m_cameraRecording) m_cameraRecording->RecordMove(direction);
+}
+
+void MainScene::ToggleCameraRecording()
+{
+  std::string fileName = FileUtils::getInstance()->getWritablePath() + jevo::config::cameraPathFileName;
+
+  if (m_cameraRecording)
+  {
+    bool result = m_cameraRecording->Save(fileName);
+    KOMORKI_LOG("Camera path %s: %s, %zu events", result ? "saved" : "failed", fileName.c_str(), m_cameraRecording->m_events.size());
+    m_cameraRecording = nullptr;
+    return;
+  }
+
+  if (!m_viewport) return;
+
+  const auto& worldModel = m_viewport->GetWorldModel();
+  m_cameraRecording.reset(new jevo::CameraPath());
+  m_cameraRecording->Start(worldModel->m_workingFolder,
+                           worldModel->m_playedDiffs,
+                           Director::getInstance()->getVisibleSize(),
+                           m_viewport->GetCameraOrigin(),
+                           m_viewport->GetRootNode()->getScale(),
+                           m_updateTime);
+  KOMORKI_LOG("Camera path recording started");
 }
 
 void MainScene::CreateSpeedToolBar()
@@ -392,6 +473,86 @@ void MainScene::CreateSpeedToolBar()
   SetSpeed(eSpeedNormal);
 }
 
+void MainScene::StartRenderProfiling()
+{
+#ifdef KOMORKI_PROFILER_ENABLED
+  // the director renders the queued commands between these two events
+  auto dispatcher = Director::getInstance()->getEventDispatcher();
+  m_afterVisitListener = dispatcher->addCustomEventListener(Director::EVENT_AFTER_VISIT, [this](EventCustom*)
+                                                            {
+                                                              m_renderStartTime = jevo::profiler::Now();
+                                                            });
+  m_afterDrawListener = dispatcher->addCustomEventListener(Director::EVENT_AFTER_DRAW, [this](EventCustom*)
+                                                           {
+                                                             jevo::profiler::Record("Renderer::render", m_renderStartTime, jevo::profiler::Now());
+                                                           });
+#endif
+}
+
+void MainScene::StopRenderProfiling()
+{
+  auto dispatcher = Director::getInstance()->getEventDispatcher();
+  if (m_afterVisitListener) dispatcher->removeEventListener(m_afterVisitListener);
+  if (m_afterDrawListener) dispatcher->removeEventListener(m_afterDrawListener);
+  m_afterVisitListener = nullptr;
+  m_afterDrawListener = nullptr;
+}
+
+void MainScene::CreateMinimap()
+{
+  m_minimapNode = Node::create();
+  addChild(m_minimapNode, 998);
+  
+  m_minimap = Sprite::create();
+  m_minimap->setAnchorPoint({0, 0});
+  m_minimap->setFlippedY(true);
+  m_minimapNode->addChild(m_minimap);
+  
+  m_minimapFrame = DrawNode::create();
+  m_minimapNode->addChild(m_minimapFrame);
+}
+
+void MainScene::UpdateMinimap()
+{
+  if (!m_viewport || !m_viewport->GetColorPyramid())
+  {
+    m_minimapNode->setVisible(false);
+    return;
+  }
+  
+  const auto& pyramid = m_viewport->GetColorPyramid();
+  unsigned int level = pyramid->GetLevelForSize(jevo::config::minimapSize);
+  Texture2D* texture = pyramid->GetTexture(level);
+  if (!texture)
+  {
+    m_minimapNode->setVisible(false);
+    return;
+  }
+  
+  m_minimapNode->setVisible(true);
+  
+  Size textureSize = texture->getContentSize();
+  if (m_minimap->getTexture() != texture)
+  {
+    m_minimap->setTexture(texture);
+    m_minimap->setTextureRect(Rect(0, 0, textureSize.width, textureSize.height));
+  }
+  
+  float scale = jevo::config::minimapSize / std::max(textureSize.width, textureSize.height);
+  m_minimap->setScale(scale);
+  
+  float cellToPoints = scale / (1 << level);
+  jevo::Rect visibleRect = m_viewport->GetVisiblePixelRect();
+  Vec2 bottomLeft = jevo::graphic::FromPixels(visibleRect.origin) * cellToPoints;
+  Vec2 topRight = jevo::graphic::FromPixels(visibleRect.origin + visibleRect.size) * cellToPoints;
+  Vec2 minimapSize = Vec2(textureSize.width, textureSize.height) * scale;
+  bottomLeft.clamp(Vec2::ZERO, minimapSize);
+  topRight.clamp(Vec2::ZERO, minimapSize);
+  
+  m_minimapFrame->clear();
+  m_minimapFrame->drawRect(bottomLeft, topRight, Color4F::WHITE);
+}
+
 void MainScene::SetSpeed(Speed speed)
 {
   if (m_speed == eSpeedNormal)
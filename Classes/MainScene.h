@@ -7,6 +7,9 @@
 #include "cocos2d/cocos/ui/CocosGUI.h"
 #include "IFullScreenMenu.h"
 #include "Viewport.h"
+#include "PacingController.h"
+#include "Counters.h"
+#include "CameraPath.h"
 
 
 class MainScene : public cocos2d::Layer, cocos2d::TextFieldDelegate
@@ -33,7 +36,7 @@ public:
     }
   }
   
-  virtual ~MainScene(){}
+  virtual ~MainScene();
   
 private:
   
@@ -59,10 +62,19 @@ private:
   cocos2d::ui::Button* m_menuButton;
   cocos2d::Node* m_speedToolbar;
   cocos2d::Node* m_menuNode;
+  cocos2d::Node* m_minimapNode;
+  cocos2d::Sprite* m_minimap;
+  cocos2d::DrawNode* m_minimapFrame;
 //  std::shared_ptr<MainMenu> m_mainMenu;
   std::shared_ptr<IFullScreenMenu> m_currenMenu;
   
   float m_updateTime;
+  uint64_t m_renderStartTime;
+  cocos2d::EventListenerCustom* m_afterVisitListener;
+  cocos2d::EventListenerCustom* m_afterDrawListener;
+  jevo::PacingController m_pacing;
+  jevo::counters::Sampler m_countersSampler;
+  std::unique_ptr<jevo::CameraPath> m_cameraRecording; // while the camera path is recorded
   bool m_pause;
   bool m_stopManager;
   
@@ -70,9 +82,11 @@ private:
   void ZoomIn();
   void ZoomOut();
   void Zoom(float direction);
+  void Zoom(const cocos2d::Vec2& point, float scaleOffset);
   void Move(const cocos2d::Vec2& direction, float animationDuration = 0.0f);
   
-  void timerForUpdate(float dt);
+  virtual void update(float dt) override;
+  void UpdateSimulation(float dt);
   void timerForViewportUpdate(float dt);
   void CreateMap(const jevo::graphic::Viewport::Ptr& viewport);
   
@@ -83,6 +97,12 @@ private:
   void ShowMainScreen();
   
   void CreateSpeedToolBar();
+  void StartRenderProfiling();
+  void StopRenderProfiling();
+  // starts or stops recording of the camera path to config::cameraPathFileName
+  void ToggleCameraRecording();
+  void CreateMinimap();
+  void UpdateMinimap();
   
   void SetSpeed(Speed speed);
   
@@ -0,0 +1,96 @@
+//
+//  MapDirectory.cpp
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#include "MapDirectory.h"
+#include <cassert>
+
+namespace jevo
+{
+  namespace graphic
+  {
+    //********************************************************************************************
+    void MapDirectory::Reset(Vec2ConstRef worldSize, int segmentSize)
+    {
+      assert(segmentSize > 0);
+      
+      m_entries.clear();
+      m_segmentSize = segmentSize;
+      m_columns = (worldSize.x + segmentSize - 1) / segmentSize;
+      m_rows = (worldSize.y + segmentSize - 1) / segmentSize;
+      m_slots.assign(m_columns * m_rows, kEmpty);
+    }
+    
+    //********************************************************************************************
+    const PartialMapPtr& MapDirectory::Find(Vec2ConstRef origin) const
+    {
+      static const PartialMapPtr none;
+      
+      size_t slot = GetSlot(origin);
+      if (slot == m_slots.size() || m_slots[slot] == kEmpty)
+        return none;
+      
+      return m_entries[m_slots[slot]].second;
+    }
+    
+    //********************************************************************************************
+    bool MapDirectory::Insert(Vec2ConstRef origin, const PartialMapPtr& map)
+    {
+      size_t slot = GetSlot(origin);
+      assert(slot < m_slots.size());
+      if (m_slots[slot] != kEmpty)
+        return false;
+      
+      m_slots[slot] = static_cast<unsigned int>(m_entries.size());
+      m_entries.push_back(std::make_pair(origin, map));
+      return true;
+    }
+    
+    //********************************************************************************************
+    PartialMapPtr MapDirectory::Erase(Vec2ConstRef origin)
+    {
+      size_t slot = GetSlot(origin);
+      if (slot == m_slots.size() || m_slots[slot] == kEmpty)
+        return nullptr;
+      
+      // the last entry takes the place of the removed one
+      unsigned int index = m_slots[slot];
+      PartialMapPtr map = std::move(m_entries[index].second);
+      if (index + 1 != m_entries.size())
+      {
+        m_entries[index] = std::move(m_entries.back());
+        m_slots[GetSlot(m_entries[index].first)] = index;
+      }
+      m_entries.pop_back();
+      m_slots[slot] = kEmpty;
+      
+      return map;
+    }
+    
+    //********************************************************************************************
+    void MapDirectory::Clear()
+    {
+      for (const auto& entry : m_entries)
+      {
+        m_slots[GetSlot(entry.first)] = kEmpty;
+      }
+      m_entries.clear();
+    }
+    
+    //********************************************************************************************
+    size_t MapDirectory::GetSlot(Vec2ConstRef origin) const
+    {
+      // m_slots.size() for the origins outside of the world
+      assert(origin.x % m_segmentSize == 0 && origin.y % m_segmentSize == 0);
+      PixelPos column = origin.x / m_segmentSize;
+      PixelPos row = origin.y / m_segmentSize;
+      if (column < 0 || column >= m_columns || row < 0 || row >= m_rows)
+        return m_slots.size();
+      
+      return column + static_cast<size_t>(row) * m_columns;
+    }
+  }
+}
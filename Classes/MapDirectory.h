@@ -0,0 +1,59 @@
+//
+//  MapDirectory.h
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "Common.h"
+
+namespace jevo
+{
+  namespace graphic
+  {
+    class PartialMap;
+    using PartialMapPtr = std::shared_ptr<PartialMap>;
+    
+    // Maps of the world by their origin, a dense grid with a slot per segment of the world.
+    // A lookup is an index, the maps themselves are in a vector, so they are iterated
+    // without visiting the empty slots and without copying. The order of iteration is arbitrary.
+    class MapDirectory
+    {
+    public:
+      
+      using Entry = std::pair<Vec2, PartialMapPtr>; // origin, map
+      using Entries = std::vector<Entry>;
+      
+      // drops the maps, the following origins are multiples of segmentSize inside of worldSize
+      void Reset(Vec2ConstRef worldSize, int segmentSize);
+      // nullptr if there is no map
+      const PartialMapPtr& Find(Vec2ConstRef origin) const;
+      // false if there is a map already
+      bool Insert(Vec2ConstRef origin, const PartialMapPtr& map);
+      // returns the removed map, nullptr if there was none
+      PartialMapPtr Erase(Vec2ConstRef origin);
+      void Clear();
+      
+      size_t GetSize() const { return m_entries.size(); }
+      bool IsEmpty() const { return m_entries.empty(); }
+      Entries::const_iterator begin() const { return m_entries.begin(); }
+      Entries::const_iterator end() const { return m_entries.end(); }
+      
+    private:
+      
+      static const unsigned int kEmpty = ~0u;
+      
+      size_t GetSlot(Vec2ConstRef origin) const;
+      
+      std::vector<unsigned int> m_slots; // index in m_entries
+      Entries m_entries;
+      int m_segmentSize = 1;
+      PixelPos m_columns = 0;
+      PixelPos m_rows = 0;
+    };
+  }
+}
@@ -0,0 +1,110 @@
+//
+//  PacingController.cpp
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#include "PacingController.h"
+#include "UIConfig.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace jevo
+{
+  namespace
+  {
+    float Smooth(float value, float sample)
+    {
+      return value + (sample - value) * config::pacingSmoothing;
+    }
+  }
+
+  //********************************************************************************************
+  PacingController::PacingController()
+  : m_tickTime(config::updateTime)
+  , m_updatesPerTick(config::numberOfUpdatesPerTick)
+  {
+  }
+
+  //********************************************************************************************
+  void PacingController::SetTickTime(float tickTime)
+  {
+    assert(tickTime > 0.f);
+    m_tickTime = tickTime;
+  }
+
+  //********************************************************************************************
+  float PacingController::GetTickTime() const
+  {
+    return m_tickTime;
+  }
+
+  //********************************************************************************************
+  void PacingController::BeginFrame(float dt, float speed, size_t backlog)
+  {
+    m_frameTime = Smooth(m_frameTime, dt);
+    m_workTime = Smooth(m_workTime, m_frameWork);
+    m_frameWork = 0.f;
+    m_ticksInFrame = 0;
+
+    // whatever is not playing diffs (drawing, loading maps) is taken from the target first
+    float otherTime = std::max(0.f, m_frameTime - m_workTime);
+    m_workBudget = std::max(config::targetFrameTime - otherTime, config::minWorkTimePerFrame);
+
+    // ticks which didn't fit into the previous frames are dropped instead of piling up
+    m_accumulator += dt * speed;
+    m_accumulator = std::min(m_accumulator, m_tickTime * config::maxTicksPerFrame);
+
+    UpdateBudget(backlog);
+  }
+
+  //********************************************************************************************
+  bool PacingController::NextTick()
+  {
+    if (m_accumulator < m_tickTime)
+      return false;
+
+    if (m_ticksInFrame > 0 && m_frameWork >= m_workBudget)
+      return false;
+
+    m_accumulator -= m_tickTime;
+    m_ticksInFrame += 1;
+    return true;
+  }
+
+  //********************************************************************************************
+  void PacingController::EndTick(float workTime, unsigned int playedDiffs)
+  {
+    m_frameWork += workTime;
+    if (playedDiffs > 0)
+    {
+      m_costPerDiff = Smooth(m_costPerDiff, workTime / playedDiffs);
+    }
+  }
+
+  //********************************************************************************************
+  unsigned int PacingController::GetUpdatesPerTick() const
+  {
+    return m_updatesPerTick;
+  }
+
+  //********************************************************************************************
+  void PacingController::UpdateBudget(size_t backlog)
+  {
+    // play the backlog in config::backlogDrainTime, but not slower than the nominal rate
+    float ticksToDrain = config::backlogDrainTime / m_tickTime;
+    float demand = std::max(static_cast<float>(config::numberOfUpdatesPerTick), backlog / ticksToDrain);
+
+    float updatesPerTick = demand;
+    if (m_costPerDiff > 0.f)
+    {
+      float ticks = std::max(1.f, std::floor(m_accumulator / m_tickTime));
+      float capacity = m_workBudget / (m_costPerDiff * ticks);
+      updatesPerTick = std::min(demand, std::max(capacity, static_cast<float>(config::minUpdatesPerTick)));
+    }
+
+    m_updatesPerTick = static_cast<unsigned int>(updatesPerTick);
+  }
+}
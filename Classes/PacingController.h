@@ -0,0 +1,52 @@
+//
+//  PacingController.h
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#pragma once
+
+#include <cstddef>
+
+namespace jevo
+{
+  // Decides how many diffs are played per frame. The simulation advances in fixed ticks taken from
+  // an accumulator of the frame time, every tick plays up to GetUpdatesPerTick() diffs. The number
+  // grows when the diffs pile up and shrinks when playing them doesn't fit into config::targetFrameTime.
+  class PacingController
+  {
+  public:
+
+    PacingController();
+
+    void SetTickTime(float tickTime);
+    float GetTickTime() const;
+
+    // dt is the time of the previous frame, speed scales the simulation time,
+    // backlog is the number of diffs read but not played yet
+    void BeginFrame(float dt, float speed, size_t backlog);
+    // true while the accumulator has a tick to play and the work budget of the frame is not spent
+    bool NextTick();
+    // workTime is the time (seconds) spent on the tick
+    void EndTick(float workTime, unsigned int playedDiffs);
+    unsigned int GetUpdatesPerTick() const;
+
+  private:
+
+    void UpdateBudget(size_t backlog);
+
+    float m_tickTime;
+    float m_accumulator = 0.f;
+
+    // smoothed measurements
+    float m_frameTime = 0.f;
+    float m_workTime = 0.f; // per frame
+    float m_costPerDiff = 0.f;
+
+    float m_workBudget = 0.f; // seconds of this frame for playing diffs
+    float m_frameWork = 0.f; // spent in this frame
+    unsigned int m_ticksInFrame = 0;
+    unsigned int m_updatesPerTick = 0;
+  };
+}
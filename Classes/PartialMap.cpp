@@ -9,29 +9,52 @@
 #include "UICommon.h"
 #include "Logging.h"
 #include "SpriteBatch.h"
+#include "ChunkTexture.h"
+#include "QuadLayer.h"
+#include "EffectLayer.h"
+#include "EnergyLayer.h"
+#include "Profiler.h"
+#include "Counters.h"
 
 namespace jevo
 {
   namespace graphic
   {
-    std::uint32_t PartialMap::instanceCounter = 0;
-    
     PartialMap::PartialMap()
     {
-      instanceCounter += 1;
+      counters::Add(counters::Counter::PartialMaps);
+      counters::Add(counters::Counter::ChunksCreated);
     }
     
     PartialMap::~PartialMap()
     {
-      instanceCounter -= 1;
+      PROFILE_ZONE("PartialMap::~PartialMap");
+      
+      counters::Add(counters::Counter::PartialMaps, -1);
+      counters::Add(counters::Counter::ChunksDestroyed);
 
-      m_cellMap->removeAllChildren();
-      m_cellMap->removeFromParentAndCleanup(true);
-      m_background->removeAllChildren();
-      m_background->removeFromParentAndCleanup(true);
+      if (m_cellLayer && m_cellBlock != QuadLayer::kInvalidBlock)
+      {
+        m_cellLayer->ReleaseBlock(m_cellBlock);
+      }
+      
+      if (m_effectLayer && m_effectBlock != QuadLayer::kInvalidBlock)
+      {
+        m_effectLayer->ReleaseBlock(m_effectBlock);
+      }
+      
       m_terrainBgSprite->removeFromParentAndCleanup(true);
+      if (m_cellTexture) m_cellTexture->removeFromParentAndCleanup(true);
+      if (m_energyLayer) m_energyLayer->removeFromParentAndCleanup(true);
       
-      LOG_W("%s %s instanceCounter: %d", __FUNCTION__, Description().c_str(), PartialMap::instanceCounter);
+      if (m_detached)
+      {
+        m_terrainBgSprite->release();
+        if (m_cellTexture) m_cellTexture->release();
+        if (m_energyLayer) m_energyLayer->release();
+      }
+      
+      LOG_W("%s %s instanceCounter: %d", __FUNCTION__, Description().c_str(), (int)counters::Get(counters::Counter::PartialMaps));
     }
     
     bool PartialMap::Init(int a,
@@ -40,45 +63,71 @@ namespace jevo
                           int height,
                           cocos2d::Node* superView,
                           cocos2d::Node* lightNode,
-                          const cocos2d::Vec2& offset)
+                          const cocos2d::Vec2& offset,
+                          RenderMode renderMode,
+                          QuadLayer* cellLayer,
+                          EffectLayer* effectLayer)
     {
       ChangeAABB(a, b, width, height);
       m_width = width;
       m_height = height;
       
-      m_cellMap = new SpriteBatch(); m_cellMap->autorelease();
-      m_background = new SpriteBatch();  m_background->autorelease();
       m_terrainBgSprite = new SpriteBatch();  m_terrainBgSprite->autorelease();
 
       
-      m_cellMap->setName("m_cellMap " + Description());
-      m_background->setName("m_background " + Description());
       m_terrainBgSprite->setName("m_terrainBgSprite " + Description());
       
       std::string cellTextureFileName = "blank.png";
-      m_cellMap->init(cellTextureFileName);
-      m_background->init(cellTextureFileName);
       m_terrainBgSprite->init(cellTextureFileName);
       
       auto bgSprite = m_terrainBgSprite->CreateSprite();
       bgSprite->setAnchorPoint({0, 0});
       bgSprite->setPosition({0, 0});
-      bgSprite->setScale(kSpritePosition * kSegmentSize);
+      bgSprite->setScaleX(kSpritePosition * width);
+      bgSprite->setScaleY(kSpritePosition * height);
       
-      m_cellMap->setPosition(offset);
-      m_background->setPosition(offset);
       m_terrainBgSprite->setPosition(offset);
       
       superView->addChild(m_terrainBgSprite, -1);
-      superView->addChild(m_background, 0);
-      superView->addChild(m_cellMap, 1);
+      
+      m_renderMode = renderMode;
+      m_cellLayer = cellLayer;
+      m_effectLayer = effectLayer;
+      if (m_renderMode == RenderMode::Texture)
+      {
+        m_cellTexture = new ChunkTexture(); m_cellTexture->autorelease();
+        if (!m_cellTexture->init(width, height))
+        {
+          m_cellTexture = nullptr;
+          return false;
+        }
+        m_cellTexture->setPosition(offset);
+        m_cellTexture->setScale(kSpritePosition);
+        superView->addChild(m_cellTexture, 1);
+      }
+      else
+      {
+        assert(width * height <= kSegmentSize * kSegmentSize);
+        m_cellBlock = m_cellLayer->AllocateBlock();
+        m_effectBlock = m_effectLayer->AllocateBlock();
+        
+        m_energyLayer = new EnergyLayer(); m_energyLayer->autorelease();
+        if (!m_energyLayer->init(width, height))
+        {
+          m_energyLayer = nullptr;
+          return false;
+        }
+        m_energyLayer->setPosition(offset);
+        m_energyLayer->setScale(kSpritePosition);
+        superView->addChild(m_energyLayer, 0);
+      }
       
       if (config::randomColorPerPartialMap)
         bgSprite->setColor(randomColor(10, 50));
       else
         bgSprite->setColor(config::mapBackground);
       
-      LOG_W("%s %s instanceCounter: %d", __FUNCTION__, Description().c_str(), PartialMap::instanceCounter);
+      LOG_W("%s %s instanceCounter: %d", __FUNCTION__, Description().c_str(), (int)counters::Get(counters::Counter::PartialMaps));
       
       return true;
     }
@@ -95,13 +144,64 @@ namespace jevo
     
     void PartialMap::Transfrorm(const cocos2d::Vec2& pos, float scale)
     {
-      m_cellMap->setPosition(pos);
-      m_background->setPosition(pos);
       m_terrainBgSprite->setPosition(pos);
       
-      m_cellMap->setScale(scale);
-      m_background->setScale(scale);
       m_terrainBgSprite->setScale(scale);
+      
+      if (m_cellTexture)
+      {
+        m_cellTexture->setPosition(pos);
+        m_cellTexture->setScale(scale * kSpritePosition);
+      }
+      
+      if (m_energyLayer)
+      {
+        m_energyLayer->setPosition(pos);
+        m_energyLayer->setScale(scale * kSpritePosition);
+      }
+    }
+    
+    void PartialMap::Detach()
+    {
+      assert(!m_detached);
+      m_detached = true;
+      
+      // quads of the map stay in the shared layers, they are just not drawn
+      if (m_cellBlock != QuadLayer::kInvalidBlock) m_cellLayer->SetBlockVisible(m_cellBlock, false);
+      if (m_effectBlock != QuadLayer::kInvalidBlock) m_effectLayer->SetBlockVisible(m_effectBlock, false);
+      m_terrainBgSprite->retain();
+      m_terrainBgSprite->removeFromParentAndCleanup(false);
+      if (m_cellTexture)
+      {
+        m_cellTexture->retain();
+        m_cellTexture->removeFromParentAndCleanup(false);
+      }
+      if (m_energyLayer)
+      {
+        m_energyLayer->retain();
+        m_energyLayer->removeFromParentAndCleanup(false);
+      }
+    }
+    
+    void PartialMap::Attach(cocos2d::Node* superView)
+    {
+      assert(m_detached);
+      m_detached = false;
+      
+      if (m_cellBlock != QuadLayer::kInvalidBlock) m_cellLayer->SetBlockVisible(m_cellBlock, true);
+      if (m_effectBlock != QuadLayer::kInvalidBlock) m_effectLayer->SetBlockVisible(m_effectBlock, true);
+      superView->addChild(m_terrainBgSprite, -1);
+      m_terrainBgSprite->release();
+      if (m_cellTexture)
+      {
+        superView->addChild(m_cellTexture, 1);
+        m_cellTexture->release();
+      }
+      if (m_energyLayer)
+      {
+        superView->addChild(m_energyLayer, 0);
+        m_energyLayer->release();
+      }
     }
     
     void PartialMap::ChangeAABB(int a, int b, int width, int height)
@@ -112,10 +212,100 @@ namespace jevo
       m_b2 = b + height;
     }
     
+    cocos2d::Vec2 PartialMap::GetPosition() const
+    {
+      return m_terrainBgSprite->getPosition();
+    }
+    
+    void PartialMap::SetCell(Vec2ConstRef pos, const cocos2d::Color3B& color)
+    {
+      m_cellLayer->SetQuad(m_cellBlock, GetSlot(pos), GetCellCenter(pos), cocos2d::Color4B(color));
+    }
+    
+    void PartialMap::ClearCell(Vec2ConstRef pos)
+    {
+      m_cellLayer->ClearQuad(m_cellBlock, GetSlot(pos));
+    }
+    
+    void PartialMap::PrepareCell(Vec2ConstRef pos, const cocos2d::Color3B& color)
+    {
+      m_cellLayer->PrepareQuad(m_cellBlock, GetSlot(pos), GetCellCenter(pos), cocos2d::Color4B(color));
+    }
+    
+    void PartialMap::PrepareClearCell(Vec2ConstRef pos)
+    {
+      m_cellLayer->PrepareClearQuad(m_cellBlock, GetSlot(pos));
+    }
+    
+    void PartialMap::StopCellAnimation(Vec2ConstRef pos)
+    {
+      m_cellLayer->StopTween(m_cellBlock, GetSlot(pos));
+    }
+    
+    void PartialMap::StopAnimations()
+    {
+      m_cellLayer->StopTweens(m_cellBlock);
+    }
+    
+    void PartialMap::AnimateCell(Vec2ConstRef pos, Vec2ConstRef from, float duration)
+    {
+      m_cellLayer->AnimateQuad(m_cellBlock, GetSlot(pos), GetCellCenter(from), duration);
+    }
+    
+    void PartialMap::FadeCell(Vec2ConstRef pos, const cocos2d::Color3B& color)
+    {
+      m_effectLayer->AddEffect(m_effectBlock,
+                               GetSlot(pos),
+                               GetCellCenter(pos),
+                               EffectLayer::Type::Fade,
+                               color,
+                               config::fadeInitialOpacity,
+                               1.f,
+                               config::fadeDuration);
+    }
+    
+    void PartialMap::Alert(Vec2ConstRef pos, const cocos2d::Color3B& alertColor)
+    {
+      m_effectLayer->AddEffect(m_effectBlock,
+                               GetSlot(pos),
+                               GetCellCenter(pos),
+                               EffectLayer::Type::Alert,
+                               alertColor,
+                               config::alertInitialOpacity,
+                               2.f,
+                               config::alertDuration);
+    }
+    
+    void PartialMap::SetEnergy(Vec2ConstRef pos, const cocos2d::Color3B& color)
+    {
+      m_energyLayer->SetEnergy(pos.x - m_a1, pos.y - m_b1, color);
+    }
+    
+    void PartialMap::ClearEnergy(Vec2ConstRef pos)
+    {
+      m_energyLayer->ClearEnergy(pos.x - m_a1, pos.y - m_b1);
+    }
+    
+    void PartialMap::AlertEnergy(Vec2ConstRef pos, const cocos2d::Color3B& alertColor)
+    {
+      m_energyLayer->Alert(pos.x - m_a1, pos.y - m_b1, alertColor);
+    }
+    
+    unsigned int PartialMap::GetSlot(Vec2ConstRef pos) const
+    {
+      assert(pos.x >= m_a1 && pos.x < m_a2 && pos.y >= m_b1 && pos.y < m_b2);
+      return (pos.y - m_b1) * m_width + (pos.x - m_a1);
+    }
+    
+    cocos2d::Vec2 PartialMap::GetCellCenter(Vec2ConstRef pos) const
+    {
+      return spriteVector(pos) + cocos2d::Vec2(kSpritePosition, kSpritePosition) * 0.5f;
+    }
+    
     std::string PartialMap::Description()
     {
       char buf[1024];
-      snprintf(buf, 1024 - 1, "%p x:[%d,%d] y:[%d,%d] %p", this, m_a1, m_a2, m_b1, m_b2, m_cellMap);
+      snprintf(buf, 1024 - 1, "%p x:[%d,%d] y:[%d,%d] block: %d", this, m_a1, m_a2, m_b1, m_b2, m_cellBlock);
       return std::string(buf);
     }
   }
@@ -11,8 +11,17 @@ namespace jevo
 {
   namespace graphic
   {
-    class GraphicContext;
     class SpriteBatch;
+    class ChunkTexture;
+    class QuadLayer;
+    class EffectLayer;
+    class EnergyLayer;
+    
+    enum class RenderMode
+    {
+      Sprites, // a sprite per organizm
+      Texture  // a texel per cell, one texture per map
+    };
     
     class PartialMap
     {
@@ -20,8 +29,6 @@ namespace jevo
       
       using Ptr = std::shared_ptr<PartialMap>;
       
-      static std::uint32_t instanceCounter;
-      
       PartialMap();
       virtual ~PartialMap();
       
@@ -31,13 +38,35 @@ namespace jevo
                 int height,
                 cocos2d::Node* superView,
                 cocos2d::Node* lightNode,
-                const cocos2d::Vec2& offset);
+                const cocos2d::Vec2& offset,
+                RenderMode renderMode,
+                QuadLayer* cellLayer,
+                EffectLayer* effectLayer);
 
       void EnableFancyAnimations(bool enable);
       void EnableAnimations(bool enable);
       
       void Transfrorm(const cocos2d::Vec2& pos, float scale);
+      // removes the map nodes from the scene keeping the sprites alive, used by the maps cache
+      void Detach();
+      void Attach(cocos2d::Node* superView);
       void ChangeAABB(int a, int b, int width, int height);
+      cocos2d::Vec2 GetPosition() const;
+      
+      // cells are in the world coordinates, only RenderMode::Sprites
+      void SetCell(Vec2ConstRef pos, const cocos2d::Color3B& color);
+      void ClearCell(Vec2ConstRef pos);
+      void AnimateCell(Vec2ConstRef pos, Vec2ConstRef from, float duration);
+      // SetCell and ClearCell which may run on a worker, StopCellAnimation finishes them on the main thread
+      void PrepareCell(Vec2ConstRef pos, const cocos2d::Color3B& color);
+      void PrepareClearCell(Vec2ConstRef pos);
+      void StopCellAnimation(Vec2ConstRef pos);
+      void StopAnimations();
+      void FadeCell(Vec2ConstRef pos, const cocos2d::Color3B& color);
+      void Alert(Vec2ConstRef pos, const cocos2d::Color3B& alertColor);
+      void SetEnergy(Vec2ConstRef pos, const cocos2d::Color3B& color);
+      void ClearEnergy(Vec2ConstRef pos);
+      void AlertEnergy(Vec2ConstRef pos, const cocos2d::Color3B& alertColor);
       
       std::string Description();
       
@@ -47,16 +76,22 @@ namespace jevo
       int m_height;
       int m_a2;
       int m_b2;
-      SpriteBatch* m_cellMap;
-      SpriteBatch* m_background;
+      QuadLayer* m_cellLayer = nullptr; // shared by all maps
+      int m_cellBlock = -1; // a quad per cell in m_cellLayer, only in RenderMode::Sprites
+      EffectLayer* m_effectLayer = nullptr; // shared by all maps
+      int m_effectBlock = -1; // a ring buffer of the effects in m_effectLayer, only in RenderMode::Sprites
+      ChunkTexture* m_cellTexture = nullptr; // only in RenderMode::Texture
+      EnergyLayer* m_energyLayer = nullptr; // only in RenderMode::Sprites
+      RenderMode m_renderMode = RenderMode::Sprites;
+      bool m_detached = false;
       
-      // just holders for GraphicContexts
       bool m_enableAnimations = false;
       bool m_enableFancyAnimations = false;
       
-      std::set<GraphicContext*> m_contexts; // for debug only
-      
     private:
+      
+      unsigned int GetSlot(Vec2ConstRef pos) const;
+      cocos2d::Vec2 GetCellCenter(Vec2ConstRef pos) const;
 
       SpriteBatch* m_terrainBgSprite;
       
@@ -6,147 +6,235 @@
 //
 
 #include "PartialMapsManager.h"
-#include "GraphicContext.h"
 #include "PartialMap.h"
 #include "SharedUIData.h"
 #include "UIConfig.h"
 #include "Logging.h"
 #include "SharedUIData.h"
 #include "SpriteBatch.h"
+#include "ChunkTexture.h"
+#include "QuadLayer.h"
+#include "EffectLayer.h"
+#include "UICommon.h"
+#include "Profiler.h"
+#include "Counters.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <chrono>
 
 namespace jevo
 {
   namespace graphic
   {
     //********************************************************************************************
-    Vec2 GetMapOriginFromPos(const Vec2& pos)
+    Vec2 GetMapOriginFromPos(const Vec2& pos, int segmentSize)
     {
-      return Vec2((pos.x/kSegmentSize) * kSegmentSize,
-                  (pos.y/kSegmentSize) * kSegmentSize);
+      return Vec2((pos.x/segmentSize) * segmentSize,
+                  (pos.y/segmentSize) * segmentSize);
     }
     
     //********************************************************************************************
     void PartialMapsManager::Update(const CreateMapArgs &createMapArgs,
                                     const RemoveMapArgs& mapsToRemove,
-                                    const WorldModelDiffVect &worldUpdate,
+                                    const WorldModelDiffBuckets &worldUpdate,
                                     float animationDuration)
     {
+      PROFILE_ZONE("PartialMapsManager::Update");
+      
       for (auto& m : mapsToRemove)
       {
         
-        auto it = m_map.find(GetMapOriginFromPos(m));
-        assert(it != m_map.end());
-        LOG_W("PartialMapsManager::Update. Delete maps. Map: %s", it->second->Description().c_str());
-        RemoveMap(it->second);
-        m_map.erase(it->first);
+        PartialMapPtr map = m_map.Erase(GetMapOrigin(m));
+        assert(map);
+        
+        if (IsPending(map))
+        {
+          LOG_W("PartialMapsManager::Update. Delete maps. Map: %s", map->Description().c_str());
+          RemoveMap(map);
+        }
+        else
+        {
+          CacheMap(map);
+        }
       }
       
+      TrimCache();
+      
       for (const auto& createMapArg : createMapArgs)
       {
         auto map = CreateMap(createMapArg);
       }
       
-      for (const auto& u : worldUpdate)
+      PrepareBuckets(worldUpdate);
+      
+      // animations and effects go to the layers shared by the maps, they stay on the main thread
+      if (m_renderMode == RenderMode::Sprites)
+      {
+        PROFILE_ZONE("PartialMapsManager::AnimateBuckets");
+        for (const auto& job : m_bucketJobs)
+        {
+          for (const auto& u : job.bucket->diffs)
+          {
+            job.map->StopCellAnimation(u.sourcePos);
+            if (u.destinationPos != u.sourcePos) job.map->StopCellAnimation(u.destinationPos);
+            AnimateUpdate(u, job.map, job.map, animationDuration);
+          }
+        }
+      }
+      m_bucketJobs.clear();
+      
+      for (const auto& u : worldUpdate.GetCrossChunkMoves())
       {
         ProccessUpdate(u, animationDuration);
       }
       
+      FlushTextures();
+      
       HealthCheck();
     }
     
     //********************************************************************************************
     void PartialMapsManager::ProccessUpdate(const WorldModelDiff& u, float animationDuration)
     {
-      Vec2 initialPos = u.sourcePos;
-      
-      DiffType type = u.type;
-      
-      Vec2 destinationPos = initialPos;
-      
-      OrganizmPtr organizm = u.organizm;
+      PartialMapPtr sourceMap = GetMap(GetMapOrigin(u.sourcePos));
+      PartialMapPtr destinationMap = u.destinationPos == u.sourcePos ? sourceMap : GetMap(GetMapOrigin(u.destinationPos));
+      ProccessUpdate(u, sourceMap, destinationMap, animationDuration);
+    }
+    
+    //********************************************************************************************
+    void PartialMapsManager::ProccessUpdate(const WorldModelDiff& u,
+                                            const PartialMapPtr& sourceMap,
+                                            const PartialMapPtr& destinationMap,
+                                            float animationDuration)
+    {
+      if (m_renderMode == RenderMode::Texture)
+      {
+        // textures show the current state of the cells, no need to replay the diff
+        if (sourceMap) UpdateTexel(sourceMap, u.sourcePos);
+        if (destinationMap && u.destinationPos != u.sourcePos) UpdateTexel(destinationMap, u.destinationPos);
+        return;
+      }
       
-      assert(organizm);
+      // quads show the current state of the cells, the diff only decides on animations and effects
+      if (sourceMap) UpdateCell(sourceMap, u.sourcePos);
+      if (destinationMap && u.destinationPos != u.sourcePos) UpdateCell(destinationMap, u.destinationPos);
       
-      auto context = organizm->GetGraphicContext();
+      AnimateUpdate(u, sourceMap, destinationMap, animationDuration);
+    }
+    
+    //********************************************************************************************
+    void PartialMapsManager::PrepareBuckets(const WorldModelDiffBuckets& worldUpdate)
+    {
+      PROFILE_ZONE("PartialMapsManager::PrepareBuckets");
       
-      if(type == DiffType::Move)
+      // a chunk of the world is inside of a single map, its diffs need one lookup
+      assert(m_segmentSize % SparseWorld::kChunkSize == 0);
+      m_bucketJobs.clear();
+      for (size_t i = 0; i < worldUpdate.GetBucketCount(); ++i)
       {
-        if (!context)
-          return;
+        const auto& bucket = worldUpdate.GetBucket(i);
+        PartialMapPtr map = GetMap(GetMapOrigin(bucket.chunkOrigin));
+        if (!map)
+          continue;
         
-        destinationPos = u.destinationPos;
+        m_bucketJobs.push_back({map, &bucket});
       }
       
-      PartialMapPtr initialMap = GetMap(GetMapOriginFromPos(initialPos));
-      PartialMapPtr destinationMap = GetMap(GetMapOriginFromPos(destinationPos));
-      
-      if (!initialMap && !destinationMap)
+      // a texture map has several chunks, a map is written by one task
+      std::sort(m_bucketJobs.begin(), m_bucketJobs.end(), [](const BucketJob& a, const BucketJob& b)
+                {
+                  return a.map.get() < b.map.get();
+                });
+      m_mapJobs.clear();
+      for (size_t i = 0; i < m_bucketJobs.size(); ++i)
       {
-        if (context)
+        if (i == 0 || m_bucketJobs[i].map != m_bucketJobs[i - 1].map)
         {
-          DeleteFromMap(organizm);
+          m_mapJobs.push_back(i);
         }
-        return;
       }
-      
-      if (!destinationMap)
+      m_mapJobs.push_back(m_bucketJobs.size());
+      
+      JobSystem::GetShared().ParallelFor(m_mapJobs.size() - 1, [this](size_t map)
+                                         {
+                                           PROFILE_ZONE("PartialMapsManager::PrepareMap");
+                                           for (size_t i = m_mapJobs[map]; i < m_mapJobs[map + 1]; ++i)
+                                           {
+                                             PrepareDiffs(m_bucketJobs[i].map, m_bucketJobs[i].bucket->diffs);
+                                           }
+                                         });
+    }
+    
+    //********************************************************************************************
+    void PartialMapsManager::PrepareDiffs(const PartialMapPtr& map, const WorldModelDiffVect& diffs)
+    {
+      bool texture = m_renderMode == RenderMode::Texture;
+      for (const auto& u : diffs)
+      {
+        if (texture)
+        {
+          UpdateTexel(map, u.sourcePos);
+          if (u.destinationPos != u.sourcePos) UpdateTexel(map, u.destinationPos);
+        }
+        else
+        {
+          PrepareCell(map, u.sourcePos, m_worldModel->GetItem(u.sourcePos));
+          if (u.destinationPos != u.sourcePos) PrepareCell(map, u.destinationPos, m_worldModel->GetItem(u.destinationPos));
+        }
+      }
+    }
+    
+    //********************************************************************************************
+    void PartialMapsManager::AnimateUpdate(const WorldModelDiff& u,
+                                           const PartialMapPtr& sourceMap,
+                                           const PartialMapPtr& destinationMap,
+                                           float animationDuration)
+    {
+      if (u.energy)
       {
-        assert(context);
-        DeleteFromMap(organizm);
+        // energy is not animated, its alerts are texels of the energy layer instead of effect quads
+        if (u.type == DiffType::Move || !m_enableEffects || !destinationMap || destinationMap->m_detached)
+          return;
+        
+        destinationMap->AlertEnergy(u.destinationPos, u.type == DiffType::Add ? cocos2d::Color3B::GREEN : cocos2d::Color3B::BLUE);
         return;
       }
       
-      if (type == DiffType::Move)
+      assert(u.organizm);
+      
+      if (u.type == DiffType::Move)
       {
-        PartialMapPtr mapForAction = destinationMap ? destinationMap : initialMap;
+        if (!destinationMap)
+          return;
         
-        // create context if it's needed
-        if (!context)
+        bool animated = destinationMap->m_enableAnimations && u.destinationPixel->organizm == u.organizm;
+        if (animated)
         {
-          context = CreateGraphicContext(u.destinationPixel,
-                                        initialPos,
-                                        mapForAction);
+          destinationMap->AnimateCell(u.destinationPos, u.sourcePos, animationDuration * 0.9);
         }
         
-        assert(context);
-        
-        int steps = 0;
-        Move(context,
-             initialPos,
-             destinationPos,
-             mapForAction,
-             steps,
-             animationDuration);
-        
-        context->FadeCell();
+        // the trace is left where the quad starts to move from
+        const PartialMapPtr& fadeMap = animated ? sourceMap : destinationMap;
+        if (m_enableEffects && fadeMap && !fadeMap->m_detached)
+        {
+          fadeMap->FadeCell(animated ? u.sourcePos : u.destinationPos, u.organizm->GetColor());
+        }
         
         return;
       }
       
-      if (type == DiffType::Add)
+      if (!m_enableEffects || !destinationMap || destinationMap->m_detached)
+        return;
+      
+      if (u.type == DiffType::Add)
       {
-        assert(context == nullptr);
-        PartialMapPtr mapForAction = destinationMap ? destinationMap : initialMap;
-        context = CreateGraphicContext(u.destinationPixel,
-                                      destinationPos,
-                                      mapForAction);
-        assert(context);
-        if (organizm->GetId() == 0) context->Alert(cocos2d::Color3B::GREEN);
-        if (organizm->GetId() != 0) context->Alert(cocos2d::Color3B::YELLOW);
+        destinationMap->Alert(u.destinationPos, cocos2d::Color3B::YELLOW);
       }
       
-      if (type == DiffType::Delete)
+      if (u.type == DiffType::Delete)
       {
-        if (!context)
-        {
-          return;
-        }
-        
-        assert(context);
-        context->FadeCell();
-        if (organizm->GetId() == 0) context->Alert(cocos2d::Color3B::BLUE);
-        if (organizm->GetId() != 0) context->Alert(cocos2d::Color3B::RED);
-        DeleteFromMap(organizm);
+        destinationMap->FadeCell(u.destinationPos, u.organizm->GetColor());
+        destinationMap->Alert(u.destinationPos, cocos2d::Color3B::RED);
       }
     }
     
@@ -156,55 +244,63 @@ namespace jevo
       if (!config::healthCheck)
         return;
       
-      auto size = m_worldModel->GetSize();
-      for (int i = 0; i < size.x; ++i)
+      auto instanceCounter = counters::Get(counters::Counter::PartialMaps);
+      assert(instanceCounter == static_cast<int64_t>(m_map.GetSize() + m_cache.GetSize()));
+      
+      unsigned int mapsWithQuads = 0;
+      for (const auto& m : m_map)
       {
-        for (int j = 0; j < size.y; ++j)
-        {
-          auto pos = Vec2(i, j);
-          
-          auto pd = m_worldModel->GetItem(pos);
-          assert(pd);
-          if (!pos.In(m_visibleArea) && pd->organizm)
-          {
-            assert(!pd->organizm->GetGraphicContext());
-          }
-        }
+        if (m.second->m_renderMode == RenderMode::Sprites) mapsWithQuads += 1;
       }
-      
-      auto instanceCounter = PartialMap::instanceCounter;
-      assert(instanceCounter == m_map.size());
+      for (const auto& m : m_cache)
+      {
+        if (m.second->m_renderMode == RenderMode::Sprites) mapsWithQuads += 1;
+      }
+      assert(mapsWithQuads == m_cellLayer->GetNumberOfBlocks());
+      assert(mapsWithQuads == m_effectLayer->GetNumberOfBlocks());
+      assert(m_effectLayer->GetNumberOfEffects() <= config::effectsBudget);
     }
     
     //********************************************************************************************
     PartialMapPtr PartialMapsManager::CreateMap(const CreateMapArg& args)
     {
+      PROFILE_ZONE("PartialMapsManager::CreateMap");
+      
+      auto cachedMap = RestoreMap(args);
+      if (cachedMap)
+        return cachedMap;
+      
       auto map = std::make_shared<graphic::PartialMap>();
-      map->Init(args.rect.origin.x,
-                args.rect.origin.y,
-                args.rect.size.x,
-                args.rect.size.y,
-                m_mainNode,
-                m_lightNode,
-                cocos2d::Vec2::ZERO);
+      bool initialized = map->Init(args.rect.origin.x,
+                                   args.rect.origin.y,
+                                   args.rect.size.x,
+                                   args.rect.size.y,
+                                   m_mainNode,
+                                   m_lightNode,
+                                   cocos2d::Vec2::ZERO,
+                                   m_renderMode,
+                                   m_cellLayer,
+                                   m_effectLayer);
+      if (!initialized)
+      {
+        // the blocks and the nodes of the map are released with it, the area stays empty
+        KOMORKI_LOG("PartialMapsManager::CreateMap. Failed to create %s", map->Description().c_str());
+        return nullptr;
+      }
 
       map->Transfrorm(args.graphicPos, 1.0);
       map->EnableAnimations(m_enableAnimations);
       map->EnableFancyAnimations(m_enableFancyAnimaitons);
       
-      auto it = m_map.insert(std::make_pair(GetMapOriginFromPos(args.rect.origin), map));
-      assert(it.second);
+      bool inserted = m_map.Insert(GetMapOrigin(args.rect.origin), map);
+      assert(inserted);
       
-      for (int i = map->m_a1; i < map->m_a2; ++i)
-      {
-        for (int j = map->m_b1; j < map->m_b2; ++j)
-        {
-          auto pos = Vec2(i, j);
-          auto pd = m_worldModel->GetItem(pos);
-          assert(pd);
-          CreateGraphicContext(pd, pos, map);
-        }
-      }
+      // organizms are created later by MaterializePendingMaps, the terrain is a placeholder until then
+      PendingMap pendingMap;
+      pendingMap.map = map;
+      pendingMap.column = map->m_a1;
+      m_pendingMaps.push_back(pendingMap);
+      m_pendingMapsSorted = false;
       
       LOG_W("PartialMapsManager::CreateMap. %s", map->Description().c_str());
       
@@ -220,11 +316,17 @@ namespace jevo
     //********************************************************************************************
     PartialMapPtr PartialMapsManager::GetMap(Vec2ConstRef pos)
     {
-      auto it = m_map.find(pos);
-      if (m_map.end() == it)
-        return nullptr;
-      else
-        return it->second;
+      const PartialMapPtr& map = m_map.Find(pos);
+      if (map)
+        return map;
+      
+      return m_cache.Find(pos);
+    }
+    
+    //********************************************************************************************
+    Vec2 PartialMapsManager::GetMapOrigin(Vec2ConstRef pos) const
+    {
+      return GetMapOriginFromPos(pos, m_segmentSize);
     }
     
     //********************************************************************************************
@@ -242,52 +344,61 @@ namespace jevo
         m.second->EnableAnimations(m_enableAnimations);
         m.second->EnableFancyAnimations(m_enableFancyAnimaitons);
       }
+    }
+    
+    //********************************************************************************************
+    void PartialMapsManager::Reset(RenderMode renderMode, int segmentSize)
+    {
+      // quad blocks of the cell and the effect layers are sized for kSegmentSize maps
+      assert(renderMode == RenderMode::Texture || segmentSize <= kSegmentSize);
       
-      for (int i = m_visibleArea.origin.x; i < m_visibleArea.origin.x + m_visibleArea.size.x; ++i)
+      ClearCache();
+      for (const auto& m : m_map)
       {
-        for (int j = m_visibleArea.origin.y; j < m_visibleArea.origin.y + m_visibleArea.size.y; ++j)
-        {
-          auto pos = Vec2(i, j);
-          const GraphicContextPtr& graphicContext = GetGraphicContext(pos);
-          if (graphicContext)
-          {
-            graphicContext->ToggleAnimation();
-          }
-        }
+        RemoveMap(m.second);
       }
+      assert(m_pendingMaps.empty());
+      
+      m_renderMode = renderMode;
+      m_segmentSize = segmentSize;
+      m_map.Reset(m_worldModel->GetSize(), m_segmentSize);
+      m_cache.Reset(m_worldModel->GetSize(), m_segmentSize);
+    }
+    
+    //********************************************************************************************
+    int PartialMapsManager::GetSegmentSize() const
+    {
+      return m_segmentSize;
     }
     
     //********************************************************************************************
     PartialMapsManager::~PartialMapsManager()
     {
-      auto contextInstanceCount = GraphicContext::instanceCounter;
+      m_pendingMaps.clear();
+      m_map.Clear();
+      m_cache.Clear();
+      m_cacheOrder.clear();
       
-      auto deletedContext = 0;
+      auto partialMapsCount = counters::Get(counters::Counter::PartialMaps);
+      assert(partialMapsCount == 0);
       
-      auto size = m_worldModel->GetSize();
-      for (int i = 0; i < size.x; ++i)
+      if (m_cellLayer)
       {
-        for (int j = 0; j < size.y; ++j)
-        {
-          auto pos = Vec2(i, j);
-          auto pixel = m_worldModel->GetItem(pos);
-          auto organizm = pixel->organizm;
-          
-          if (!organizm || !organizm->GetGraphicContext()) continue;
-          
-          organizm->SetGraphicContext(nullptr);
-          deletedContext += 1;
-        }
+        auto blocks = m_cellLayer->GetNumberOfBlocks();
+        assert(blocks == 0);
+        m_cellLayer->removeFromParentAndCleanup(true);
+        m_cellLayer->release();
+        m_cellLayer = nullptr;
       }
       
-      auto contextInstanceCountAfterRemoval = GraphicContext::instanceCounter;
-      assert(contextInstanceCountAfterRemoval == 0);
-      assert(deletedContext == contextInstanceCount);
-      
-      m_map.clear();
-      
-      auto partialMapsCount = PartialMap::instanceCounter;
-      assert(partialMapsCount == 0);
+      if (m_effectLayer)
+      {
+        auto blocks = m_effectLayer->GetNumberOfBlocks();
+        assert(blocks == 0);
+        m_effectLayer->removeFromParentAndCleanup(true);
+        m_effectLayer->release();
+        m_effectLayer = nullptr;
+      }
       
       auto mainNodeChildrenCount = m_mainNode->getChildren().size();
       assert(mainNodeChildrenCount == 0);
@@ -297,102 +408,379 @@ namespace jevo
       
       graphic::SharedUIData::getInstance()->m_textureMap.clear();
       
-      auto sprites = SpriteBatch::instanceCounter;
+      auto sprites = counters::Get(counters::Counter::SpriteBatches);
       assert(sprites == 0);
     }
     
     //********************************************************************************************
-    GraphicContextPtr PartialMapsManager::CreateGraphicContext(GreatPixel* pixel,
-                                                               Vec2ConstRef pos,
-                                                               const PartialMapPtr& map)
+    void PartialMapsManager::Init()
+    {
+      assert(m_mainNode);
+      assert(!m_cellLayer);
+      
+      m_cellLayer = new QuadLayer();
+      m_cellLayer->init("blank.png", kSegmentSize * kSegmentSize, kSpriteScale);
+      m_cellLayer->setName("m_cellLayer");
+      m_mainNode->addChild(m_cellLayer, 1);
+      
+      m_effectLayer = new EffectLayer();
+      m_effectLayer->init("blank.png", config::effectsPerMap, kSegmentSize * kSegmentSize, kSpriteScale);
+      m_effectLayer->setName("m_effectLayer");
+      m_mainNode->addChild(m_effectLayer, 0);
+      
+      m_map.Reset(m_worldModel->GetSize(), m_segmentSize);
+      m_cache.Reset(m_worldModel->GetSize(), m_segmentSize);
+    }
+    
+    //********************************************************************************************
+    void PartialMapsManager::SetLoadedOrigin(Vec2ConstRef origin)
+    {
+      // maps are placed relative to the loaded rect, quads of the cell layer are in the world coordinates
+      m_cellLayer->setPosition(-spriteVector(origin));
+      m_effectLayer->setPosition(-spriteVector(origin));
+    }
+    
+    //********************************************************************************************
+    void PartialMapsManager::RemoveMap(const PartialMapPtr& map)
+    {
+      PROFILE_ZONE("PartialMapsManager::RemoveMap");
+      
+      m_pendingMaps.remove_if([&map](const PendingMap& pendingMap)
+                              {
+                                return pendingMap.map == map;
+                              });
+      // the quads of the map are released together with the map
+    }
+
+    //********************************************************************************************
+    void PartialMapsManager::CacheMap(const PartialMapPtr& map)
+    {
+      LOG_W("PartialMapsManager::CacheMap. %s", map->Description().c_str());
+      
+      map->Detach();
+      // diffs of the cached area are applied without animations
+      map->EnableAnimations(false);
+      map->EnableFancyAnimations(false);
+      
+      Vec2 origin = GetMapOrigin(Vec2(map->m_a1, map->m_b1));
+      bool inserted = m_cache.Insert(origin, map);
+      assert(inserted);
+      m_cacheOrder.push_front(origin);
+    }
+    
+    //********************************************************************************************
+    PartialMapPtr PartialMapsManager::RestoreMap(const CreateMapArg& args)
     {
-      const OrganizmPtr& organizm = pixel->organizm;
+      Vec2 origin = GetMapOrigin(args.rect.origin);
+      PartialMapPtr map = m_cache.Erase(origin);
+      if (!map)
+        return nullptr;
+      
+      m_cacheOrder.remove(origin);
       
-      if (!organizm)
+      if (map->m_a1 != args.rect.origin.x ||
+          map->m_b1 != args.rect.origin.y ||
+          map->m_width != args.rect.size.x ||
+          map->m_height != args.rect.size.y ||
+          map->m_renderMode != m_renderMode)
+      {
+        RemoveMap(map);
+        UpdateCachedRects();
         return nullptr;
+      }
+      
+      LOG_W("PartialMapsManager::RestoreMap. %s", map->Description().c_str());
+      
+      map->Attach(m_mainNode);
+      map->Transfrorm(args.graphicPos, 1.0);
+      map->EnableAnimations(m_enableAnimations);
+      map->EnableFancyAnimations(m_enableFancyAnimaitons);
+      if (map->m_cellTexture) map->m_cellTexture->Flush();
+      
+      bool inserted = m_map.Insert(origin, map);
+      assert(inserted);
       
-      GraphicContextPtr context = organizm->GetGraphicContext();
-      if (context)
+      UpdateCachedRects();
+      
+      return map;
+    }
+    
+    //********************************************************************************************
+    void PartialMapsManager::TrimCache()
+    {
+      unsigned int cost = 0;
+      for (const auto& m : m_cache)
       {
-        context->BecomeOwner(map);
-        context->tt_pos = pos;
-        return context;
+        cost += GetCacheCost(m.second);
       }
       
-      auto textureRect = cocos2d::Rect(0, 0, 1, 1);
+      // the least recently used maps go first
+      while (!m_cacheOrder.empty() &&
+             (m_cache.GetSize() > config::mapCacheMaxMaps || cost > config::mapCacheQuadBudget))
+      {
+        PartialMapPtr map = m_cache.Erase(m_cacheOrder.back());
+        assert(map);
+        cost -= GetCacheCost(map);
+        
+        LOG_W("PartialMapsManager::TrimCache. Delete maps. Map: %s", map->Description().c_str());
+        RemoveMap(map);
+        m_cacheOrder.pop_back();
+      }
       
-      auto rect = Rect(pos, Vec2(1, 1));
-      context = std::make_shared<GraphicContext>(organizm->GetId(),
-                                                 map,
-                                                 organizm->GetColor(),
-                                                 textureRect,
-                                                 pos,
-                                                 rect);
-      organizm->SetGraphicContext(context);
-      context->tt_pos = pos;
-      context->ToggleAnimation();
+      UpdateCachedRects();
+    }
+    
+    //********************************************************************************************
+    unsigned int PartialMapsManager::GetCacheCost(const PartialMapPtr& map) const
+    {
+      // a cell quad or a texel per cell plus the effects ring
+      return map->m_width * map->m_height + (map->m_effectBlock != QuadLayer::kInvalidBlock ? config::effectsPerMap : 0);
+    }
+    
+    //********************************************************************************************
+    void PartialMapsManager::ClearCache()
+    {
+      for (const auto& m : m_cache)
+      {
+        RemoveMap(m.second);
+      }
+      m_cache.Clear();
+      m_cacheOrder.clear();
       
-      return context;
+      UpdateCachedRects();
     }
     
     //********************************************************************************************
-    GraphicContextPtr PartialMapsManager::GetGraphicContext(Vec2 pos) const
+    void PartialMapsManager::UpdateCachedRects()
     {
-      auto pd = m_worldModel->GetItem(pos);
-      assert(pd);
-      return pd->organizm ? pd->organizm->GetGraphicContext() : nullptr;
+      auto& cachedRects = m_worldModel->m_cachedRects;
+      cachedRects.clear();
+      for (const auto& m : m_cache)
+      {
+        const PartialMapPtr& map = m.second;
+        cachedRects.push_back(Rect(map->m_a1, map->m_b1, map->m_width, map->m_height));
+      }
     }
     
     //********************************************************************************************
-    void PartialMapsManager::RemoveMap(const PartialMapPtr& map)
+    bool PartialMapsManager::IsPending(const PartialMapPtr& map) const
     {
-      for (int i = map->m_a1; i < map->m_a2; ++i)
+      for (const auto& pendingMap : m_pendingMaps)
       {
-        for (int j = map->m_b1; j < map->m_b2; ++j)
-        {
-          auto pos = Vec2(i, j);
-          auto pixel = m_worldModel->GetItem(pos);
-          auto organizm = pixel->organizm;
-          
-          if (!organizm) continue;
-          
-          auto graphicContext = organizm->GetGraphicContext();
-          
-          if (graphicContext)
-          {
-            graphicContext->Destory();
-            organizm->SetGraphicContext(nullptr);
-          }
-        }
+        if (pendingMap.map == map)
+          return true;
       }
+      return false;
     }
 
     //********************************************************************************************
-    void PartialMapsManager::DeleteFromMap(const OrganizmPtr& organizm)
+    void PartialMapsManager::MaterializePendingMaps(float timeBudget)
     {
-      const GraphicContextPtr& graphicContext = organizm->GetGraphicContext();
+      if (m_pendingMaps.empty())
+        return;
+      
+      auto startTime = std::chrono::steady_clock::now();
+      
+      if (!m_pendingMapsSorted || m_sortedFocusPoint != m_focusPoint)
+      {
+        m_pendingMaps.sort([this](const PendingMap& a, const PendingMap& b)
+                           {
+                             return DistanceToFocus(a.map) < DistanceToFocus(b.map);
+                           });
+        m_pendingMapsSorted = true;
+        m_sortedFocusPoint = m_focusPoint;
+      }
+      
+      while (!m_pendingMaps.empty())
+      {
+        PendingMap& pendingMap = m_pendingMaps.front();
+        MaterializeColumn(pendingMap.map, pendingMap.column);
+        pendingMap.column += 1;
+        
+        if (pendingMap.column >= pendingMap.map->m_a2)
+        {
+          LOG_W("PartialMapsManager::MaterializePendingMaps. Done %s", pendingMap.map->Description().c_str());
+          m_pendingMaps.pop_front();
+        }
+        
+        std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - startTime;
+        if (elapsed.count() >= timeBudget)
+          break;
+      }
       
-      if (graphicContext == nullptr)
+      FlushTextures();
+    }
+    
+    //********************************************************************************************
+    void PartialMapsManager::MaterializeColumn(const PartialMapPtr& map, int column)
+    {
+      for (int j = map->m_b1; j < map->m_b2; ++j)
+      {
+        auto pos = Vec2(column, j);
+        auto pd = m_worldModel->GetItem(pos);
+        if (!pd || pd->IsEmpty())
+          continue;
+        
+        if (map->m_renderMode == RenderMode::Texture)
+        {
+          map->m_cellTexture->SetCell(column - map->m_a1, j - map->m_b1, cocos2d::Color4B(pd->GetColor()));
+        }
+        else if (pd->energy)
+        {
+          map->SetEnergy(pos, pd->energyColor);
+        }
+        else
+        {
+          map->SetCell(pos, pd->organizm->GetColor());
+        }
+      }
+    }
+    
+    //********************************************************************************************
+    float PartialMapsManager::DistanceToFocus(const PartialMapPtr& map) const
+    {
+      float dx = (map->m_a1 + map->m_a2) * 0.5f - m_focusPoint.x;
+      float dy = (map->m_b1 + map->m_b2) * 0.5f - m_focusPoint.y;
+      return dx * dx + dy * dy;
+    }
+    
+    //********************************************************************************************
+    void PartialMapsManager::FlushTextures()
+    {
+      if (m_renderMode != RenderMode::Texture)
         return;
       
-      graphicContext->Destory();
-      organizm->SetGraphicContext(nullptr);
+      for (const auto& m : m_map)
+      {
+        m.second->m_cellTexture->Flush();
+      }
+    }
+    
+    //********************************************************************************************
+    void PartialMapsManager::Resync()
+    {
+      PROFILE_ZONE("PartialMapsManager::Resync");
+      
+      // the maps are kept, only the chunks which missed their diffs are written again
+      m_worldModel->TakeUnsyncedChunks(m_unsyncedChunks);
+      m_syncJobs.clear();
+      for (size_t chunk : m_unsyncedChunks)
+      {
+        Vec2 chunkOrigin = m_worldModel->m_map->GetChunkOrigin(chunk);
+        PartialMapPtr map = GetMap(GetMapOrigin(chunkOrigin));
+        if (map) m_syncJobs.push_back({map, chunkOrigin});
+      }
+      
+      // a map is written by one task, the animations of the quads are stopped afterwards
+      std::sort(m_syncJobs.begin(), m_syncJobs.end(), [](const SyncJob& a, const SyncJob& b)
+                {
+                  return a.map.get() < b.map.get();
+                });
+      m_syncMapJobs.clear();
+      for (size_t i = 0; i < m_syncJobs.size(); ++i)
+      {
+        if (i == 0 || m_syncJobs[i].map != m_syncJobs[i - 1].map)
+        {
+          m_syncMapJobs.push_back(i);
+        }
+      }
+      m_syncMapJobs.push_back(m_syncJobs.size());
+      
+      const PixelPos chunkSize = SparseWorld::kChunkSize;
+      JobSystem::GetShared().ParallelFor(m_syncMapJobs.size() - 1, [this, chunkSize](size_t map)
+                                         {
+                                           for (size_t i = m_syncMapJobs[map]; i < m_syncMapJobs[map + 1]; ++i)
+                                           {
+                                             SyncArea(m_syncJobs[i].map, Rect(m_syncJobs[i].chunkOrigin, Vec2(chunkSize, chunkSize)));
+                                           }
+                                         });
+      for (size_t i = 0; i + 1 < m_syncMapJobs.size(); ++i)
+      {
+        const PartialMapPtr& map = m_syncJobs[m_syncMapJobs[i]].map;
+        if (map->m_renderMode == RenderMode::Sprites) map->StopAnimations();
+      }
+      m_syncJobs.clear();
+      
+      FlushTextures();
+    }
+    
+    //********************************************************************************************
+    void PartialMapsManager::SyncArea(const PartialMapPtr& map, const Rect& area)
+    {
+      // row by row, the cells of a chunk of the world are stored by rows
+      bool texture = map->m_renderMode == RenderMode::Texture;
+      PixelPos a1 = std::max(area.Left(), map->m_a1);
+      PixelPos a2 = std::min(area.Right() + 1, map->m_a2);
+      PixelPos b1 = std::max(area.Bottom(), map->m_b1);
+      PixelPos b2 = std::min(area.Top() + 1, map->m_b2);
+      for (int j = b1; j < b2; ++j)
+      {
+        for (int i = a1; i < a2; ++i)
+        {
+          const GreatPixel* pixel = m_worldModel->m_map->Get(i, j);
+          if (texture)
+          {
+            UpdateTexel(map, Vec2(i, j), pixel);
+          }
+          else
+          {
+            PrepareCell(map, Vec2(i, j), pixel);
+          }
+        }
+      }
+    }
+    
+    //********************************************************************************************
+    void PartialMapsManager::UpdateTexel(const PartialMapPtr& map, Vec2ConstRef pos)
+    {
+      UpdateTexel(map, pos, m_worldModel->GetItem(pos));
     }
     
     //********************************************************************************************
-    void PartialMapsManager::Move(GraphicContextPtr context,
-                                  const Vec2& source,
-                                  const Vec2& dest,
-                                  const PartialMapPtr& map,
-                                  int steps,
-                                  float animationDuration)
+    void PartialMapsManager::UpdateTexel(const PartialMapPtr& map, Vec2ConstRef pos, const GreatPixel* pixel)
     {
-      assert(context);
+      cocos2d::Color4B color(0, 0, 0, 0);
+      if (pixel && !pixel->IsEmpty())
+      {
+        color = cocos2d::Color4B(pixel->GetColor());
+      }
       
-      context->BecomeOwner(map);
+      map->m_cellTexture->SetCell(pos.x - map->m_a1, pos.y - map->m_b1, color);
+    }
+    
+    //********************************************************************************************
+    void PartialMapsManager::UpdateCell(const PartialMapPtr& map, Vec2ConstRef pos)
+    {
+      UpdateCell(map, pos, m_worldModel->GetItem(pos));
+    }
+    
+    //********************************************************************************************
+    void PartialMapsManager::UpdateCell(const PartialMapPtr& map, Vec2ConstRef pos, const GreatPixel* pixel)
+    {
+      PrepareCell(map, pos, pixel);
+      map->StopCellAnimation(pos);
+    }
+    
+    //********************************************************************************************
+    void PartialMapsManager::PrepareCell(const PartialMapPtr& map, Vec2ConstRef pos, const GreatPixel* pixel)
+    {
+      if (pixel && pixel->organizm)
+      {
+        map->PrepareCell(pos, pixel->organizm->GetColor());
+      }
+      else
+      {
+        map->PrepareClearCell(pos);
+      }
       
-      context->tt_pos = dest;
-      context->Move(source, dest, animationDuration*0.9*(steps + 1));
+      if (pixel && pixel->energy)
+      {
+        map->SetEnergy(pos, pixel->energyColor);
+      }
+      else
+      {
+        map->ClearEnergy(pos);
+      }
     }
   }
 }
@@ -7,22 +7,25 @@
 
 #pragma once
 
-#include <unordered_map>
 #include <memory>
 #include <list>
 #include "Common.h"
 #include "WorldModel.h"
+#include "PartialMap.h"
+#include "MapDirectory.h"
+#include "UIConfig.h"
 
 namespace jevo
 {
   namespace graphic
   {
-    class GraphicContext;
-    class PartialMap;
+    class QuadLayer;
+    class EffectLayer;
 
-    using PartialMapPtr = std::shared_ptr<PartialMap>;
-    using Maps = std::unordered_map<Vec2, PartialMapPtr, Vec2Hasher>;
-    using GraphicContextPtr = std::shared_ptr<GraphicContext>;
+    using Maps = MapDirectory;
+    
+    // origin of the map of segmentSize x segmentSize cells that contains pos
+    Vec2 GetMapOriginFromPos(const Vec2& pos, int segmentSize);
     
     class PartialMapsManager
     {
@@ -36,38 +39,103 @@ namespace jevo
       using CreateMapArgs = std::list<CreateMapArg>;
       using RemoveMapArgs = std::list<Vec2>;
       
+      // creates the cell and the effect layers in m_mainNode
+      void Init();
       void Update(const CreateMapArgs& createMapArgs,
                   const RemoveMapArgs& mapsToRemove,
-                  const WorldModelDiffVect& worldUpdate,
+                  const WorldModelDiffBuckets& worldUpdate,
                   float animationDuration);
       void ProccessUpdate(const WorldModelDiff& diff, float animationDuration);
+      // maps of the source and the destination of the diff, nullptr when they are not loaded
+      void ProccessUpdate(const WorldModelDiff& diff,
+                          const PartialMapPtr& sourceMap,
+                          const PartialMapPtr& destinationMap,
+                          float animationDuration);
       void HealthCheck();
       
       const Maps& GetMaps() const;
       void EnableAnimation(bool enableAnimations, bool enableFancyAnimations);
+      // drops the loaded and the cached maps, the following maps are created in the given mode and size
+      void Reset(RenderMode renderMode, int segmentSize);
+      int GetSegmentSize() const;
+      // world cell that is at the origin of m_mainNode
+      void SetLoadedOrigin(Vec2ConstRef origin);
+      // creates organizms of the new maps until the time budget (seconds) is spent
+      void MaterializePendingMaps(float timeBudget);
+      // rewrites the cells of the loaded and the cached maps from the world in the chunks changed
+      // by the diffs which were not reported, see WorldModel::TakeUnsyncedChunks
+      void Resync();
       virtual ~PartialMapsManager();
       
     private:
-      using GraphicContextList = std::list<GraphicContext*>;
-      
       void PrintMap();
+      // a loaded or a cached map
       PartialMapPtr GetMap(Vec2ConstRef pos);
+      Vec2 GetMapOrigin(Vec2ConstRef pos) const;
       PartialMapPtr CreateMap(const CreateMapArg& args);
-      GraphicContextPtr CreateGraphicContext(GreatPixel* cell,
-                                           Vec2ConstRef pos,
-                                           const PartialMapPtr& map);
-      GraphicContextPtr GetGraphicContext(Vec2 pos) const;
       void RemoveMap(const PartialMapPtr& map);
-
-      void DeleteFromMap(const OrganizmPtr& organizm);
-      void Move(GraphicContextPtr context,
-                const Vec2& source,
-                const Vec2& dest,
-                const PartialMapPtr& map,
-                int steps,
-                float animationDuration);
+      void CacheMap(const PartialMapPtr& map);
+      PartialMapPtr RestoreMap(const CreateMapArg& args);
+      void TrimCache();
+      unsigned int GetCacheCost(const PartialMapPtr& map) const;
+      void ClearCache();
+      void UpdateCachedRects();
+      bool IsPending(const PartialMapPtr& map) const;
+      void MaterializeColumn(const PartialMapPtr& map, int column);
+      float DistanceToFocus(const PartialMapPtr& map) const;
+      void FlushTextures();
+      // safe for different maps at the same time, the animations of the map are not stopped
+      void SyncArea(const PartialMapPtr& map, const Rect& area);
+      void UpdateTexel(const PartialMapPtr& map, Vec2ConstRef pos);
+      void UpdateTexel(const PartialMapPtr& map, Vec2ConstRef pos, const GreatPixel* pixel);
+      void UpdateCell(const PartialMapPtr& map, Vec2ConstRef pos);
+      void UpdateCell(const PartialMapPtr& map, Vec2ConstRef pos, const GreatPixel* pixel);
+      // UpdateCell which keeps the animation of the cell, see PartialMap::PrepareCell
+      void PrepareCell(const PartialMapPtr& map, Vec2ConstRef pos, const GreatPixel* pixel);
+      // writes the cells of the buckets to their maps on the workers, a map per task
+      void PrepareBuckets(const WorldModelDiffBuckets& worldUpdate);
+      // writes the current state of the cells of the diffs, safe for different maps at the same time
+      void PrepareDiffs(const PartialMapPtr& map, const WorldModelDiffVect& diffs);
+      // animations and effects of the diff which cells are written
+      void AnimateUpdate(const WorldModelDiff& diff,
+                         const PartialMapPtr& sourceMap,
+                         const PartialMapPtr& destinationMap,
+                         float animationDuration);
+      
+      struct PendingMap
+      {
+        PartialMapPtr map;
+        int column; // next column to materialize
+      };
+      
+      struct BucketJob
+      {
+        PartialMapPtr map;
+        const WorldModelDiffBuckets::Bucket* bucket;
+      };
+      
+      struct SyncJob
+      {
+        PartialMapPtr map;
+        Vec2 chunkOrigin;
+      };
       
       Maps m_map;
+      QuadLayer* m_cellLayer = nullptr;
+      EffectLayer* m_effectLayer = nullptr;
+      std::list<PendingMap> m_pendingMaps;
+      // the pending maps are sorted by the distance to m_sortedFocusPoint unless new maps were added
+      bool m_pendingMapsSorted = true;
+      Vec2 m_sortedFocusPoint;
+      // maps removed from the scene, they still get the diffs of their area
+      Maps m_cache;
+      std::list<Vec2> m_cacheOrder; // most recently used first
+      std::vector<BucketJob> m_bucketJobs; // of the current update, sorted by map
+      std::vector<size_t> m_mapJobs; // first bucket job of every map and the end of the last one
+      std::vector<size_t> m_unsyncedChunks;
+      std::vector<SyncJob> m_syncJobs; // of the current resync, sorted by map
+      std::vector<size_t> m_syncMapJobs; // first sync job of every map and the end of the last one
+      int m_segmentSize = kSegmentSize;
 
 
       // TODO: move the fields to constructor make them private
@@ -76,8 +144,11 @@ namespace jevo
       cocos2d::Node* m_lightNode;
       std::shared_ptr<WorldModel> m_worldModel;
       Rect m_visibleArea; // visible area
+      Vec2 m_focusPoint; // maps closer to this point are materialized first
       bool m_enableAnimations = false;
       bool m_enableFancyAnimaitons = false;
+      bool m_enableEffects = true; // fades and alerts
+      RenderMode m_renderMode = RenderMode::Sprites;
     };
   }
 }
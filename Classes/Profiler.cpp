@@ -0,0 +1,153 @@
+//
+//  Profiler.cpp
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#include "Profiler.h"
+#include "UIConfig.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace jevo
+{
+  namespace profiler
+  {
+    namespace
+    {
+      struct Event
+      {
+        const char* name;
+        uint64_t start;
+        uint64_t end;
+      };
+
+      struct ThreadBuffer
+      {
+        // the owner writes, WriteTrace reads, the lock is never contended otherwise
+        std::mutex lock;
+        std::vector<Event> events;
+        size_t head = 0; // next event to write
+        size_t size = 0;
+        unsigned int threadId = 0;
+        std::string threadName;
+      };
+
+      std::mutex& BuffersLock()
+      {
+        static std::mutex lock;
+        return lock;
+      }
+
+      // buffers live until the end of the program, events of finished threads are still exported
+      std::vector<std::unique_ptr<ThreadBuffer>>& Buffers()
+      {
+        static std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+        return buffers;
+      }
+
+      ThreadBuffer* CreateThreadBuffer()
+      {
+        std::lock_guard<std::mutex> lk(BuffersLock());
+        auto& buffers = Buffers();
+        std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+        buffer->events.resize(config::profilerEventsPerThread);
+        buffer->threadId = buffers.size() + 1;
+        buffers.push_back(std::move(buffer));
+        return buffers.back().get();
+      }
+
+      ThreadBuffer* GetThreadBuffer()
+      {
+        thread_local ThreadBuffer* buffer = CreateThreadBuffer();
+        return buffer;
+      }
+
+      void WriteEscaped(std::ostream& stream, const std::string& value)
+      {
+        for (char c : value)
+        {
+          if (c == '"' || c == '\\')
+            stream << '\\';
+          stream << c;
+        }
+      }
+    }
+
+    //********************************************************************************************
+    uint64_t Now()
+    {
+      static const auto startTime = std::chrono::steady_clock::now();
+      auto time = std::chrono::steady_clock::now() - startTime;
+      return std::chrono::duration_cast<std::chrono::microseconds>(time).count();
+    }
+
+    //********************************************************************************************
+    void Record(const char* name, uint64_t start, uint64_t end)
+    {
+      ThreadBuffer* buffer = GetThreadBuffer();
+      std::lock_guard<std::mutex> lk(buffer->lock);
+      Event& event = buffer->events[buffer->head];
+      event.name = name;
+      event.start = start;
+      event.end = end;
+      buffer->head = (buffer->head + 1) % buffer->events.size();
+      buffer->size = std::min(buffer->size + 1, buffer->events.size());
+    }
+
+    //********************************************************************************************
+    void SetThreadName(const char* name)
+    {
+      ThreadBuffer* buffer = GetThreadBuffer();
+      std::lock_guard<std::mutex> lk(buffer->lock);
+      buffer->threadName = name;
+    }
+
+    //********************************************************************************************
+    bool WriteTrace(const std::string& fileName)
+    {
+      std::ofstream stream(fileName);
+      if (!stream)
+        return false;
+
+      stream << "{\"traceEvents\":[";
+      bool first = true;
+
+      std::lock_guard<std::mutex> buffersLock(BuffersLock());
+      for (const auto& buffer : Buffers())
+      {
+        std::lock_guard<std::mutex> lk(buffer->lock);
+
+        if (!buffer->threadName.empty())
+        {
+          stream << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId
+                 << ",\"args\":{\"name\":\"";
+          WriteEscaped(stream, buffer->threadName);
+          stream << "\"}}";
+          first = false;
+        }
+
+        // the oldest event first
+        size_t capacity = buffer->events.size();
+        for (size_t i = 0; i < buffer->size; ++i)
+        {
+          const Event& event = buffer->events[(buffer->head + capacity - buffer->size + i) % capacity];
+          stream << (first ? "" : ",") << "\n{\"name\":\"";
+          WriteEscaped(stream, event.name);
+          stream << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+                 << ",\"ts\":" << event.start
+                 << ",\"dur\":" << event.end - event.start << "}";
+          first = false;
+        }
+      }
+
+      stream << "\n]}\n";
+      return stream.good();
+    }
+  }
+}
@@ -0,0 +1,68 @@
+//
+//  Profiler.h
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+//#define KOMORKI_PROFILING
+
+#if defined(KOMORKI_PROFILING) || (defined(COCOS2D_DEBUG) && COCOS2D_DEBUG > 0)
+#define KOMORKI_PROFILER_ENABLED
+#endif
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+
+#ifdef KOMORKI_PROFILER_ENABLED
+// measures the rest of the scope, name has to be a string literal
+#define PROFILE_ZONE(name) jevo::profiler::Zone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__FUNCTION__)
+#define PROFILE_THREAD_NAME(name) jevo::profiler::SetThreadName(name)
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_FUNCTION()
+#define PROFILE_THREAD_NAME(name)
+#endif
+
+namespace jevo
+{
+  namespace profiler
+  {
+    // Zones are kept in a ring buffer per thread, the oldest ones are overwritten.
+    // WriteTrace exports the zones of all threads in the Chrome trace format (chrome://tracing, Perfetto).
+
+    // microseconds since the first call
+    uint64_t Now();
+    void Record(const char* name, uint64_t start, uint64_t end);
+    void SetThreadName(const char* name);
+    bool WriteTrace(const std::string& fileName);
+
+    class Zone
+    {
+    public:
+      explicit Zone(const char* name)
+      : m_name(name)
+      , m_start(Now())
+      {
+      }
+
+      ~Zone()
+      {
+        Record(m_name, m_start, Now());
+      }
+
+    private:
+      Zone(const Zone&) = delete;
+      Zone& operator=(const Zone&) = delete;
+
+      const char* m_name;
+      uint64_t m_start;
+    };
+  }
+}
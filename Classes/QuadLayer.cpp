@@ -0,0 +1,398 @@
+//
+//  QuadLayer.cpp
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#include "QuadLayer.h"
+#include "Counters.h"
+
+USING_NS_CC;
+
+namespace jevo
+{
+  namespace graphic
+  {
+    namespace
+    {
+      void SetQuadTexCoords(V2F_C4B_T2F_Quad& quad)
+      {
+        quad.bl.texCoords = Tex2F(0, 1);
+        quad.br.texCoords = Tex2F(1, 1);
+        quad.tl.texCoords = Tex2F(0, 0);
+        quad.tr.texCoords = Tex2F(1, 0);
+      }
+
+      void FillQuadColor(V2F_C4B_T2F_Quad& quad, const Color4B& color)
+      {
+        quad.bl.colors = color;
+        quad.br.colors = color;
+        quad.tl.colors = color;
+        quad.tr.colors = color;
+      }
+    }
+
+    QuadLayer::QuadLayer()
+    {
+    }
+
+    QuadLayer::~QuadLayer()
+    {
+      CC_SAFE_RELEASE_NULL(m_texture);
+
+      if (m_vbo) glDeleteBuffers(1, &m_vbo);
+      if (m_ibo) glDeleteBuffers(1, &m_ibo);
+    }
+
+    bool QuadLayer::init(const std::string& textureFileName, unsigned int quadsPerBlock, float quadSize)
+    {
+      if (!Node::init())
+      {
+        return false;
+      }
+
+      m_texture = Director::getInstance()->getTextureCache()->addImage(textureFileName);
+      if (!m_texture)
+      {
+        return false;
+      }
+
+      m_texture->retain();
+      m_texture->setAliasTexParameters();
+
+      assert(quadsPerBlock > 0 && quadsPerBlock * 4 <= kMaxBatchVertices);
+      m_quadsPerBlock = quadsPerBlock;
+      m_quadsPerBatch = (kMaxBatchVertices / 4 / quadsPerBlock) * quadsPerBlock;
+      m_halfSize = quadSize * 0.5f;
+      m_blendFunc = BlendFunc::ALPHA_PREMULTIPLIED;
+      setGLProgramState(GLProgramState::getOrCreateWithGLProgramName(GLProgram::SHADER_NAME_POSITION_TEXTURE_COLOR));
+
+      glGenBuffers(1, &m_vbo);
+      glGenBuffers(1, &m_ibo);
+      CreateIndices();
+
+      scheduleUpdate();
+
+      return true;
+    }
+
+    QuadLayer::BlockId QuadLayer::AllocateBlock()
+    {
+      BlockId block = kInvalidBlock;
+      if (!m_freeBlocks.empty())
+      {
+        block = m_freeBlocks.back();
+        m_freeBlocks.pop_back();
+      }
+      else
+      {
+        block = static_cast<BlockId>(m_blocks.size());
+        m_blocks.push_back(Block());
+        m_quads.resize(m_quads.size() + m_quadsPerBlock);
+        m_centers.resize(m_quads.size());
+        m_halfSizes.resize(m_quads.size(), m_halfSize);
+        m_tweens.SetNumberOfTargets(m_quads.size());
+      }
+
+      Block& b = m_blocks[block];
+      assert(!b.used);
+      b.used = true;
+      b.visible = true;
+      b.dirtyBegin = 0;
+      b.dirtyEnd = m_quadsPerBlock;
+
+      unsigned int first = GetQuadIndex(block, 0);
+      for (unsigned int i = first; i < first + m_quadsPerBlock; ++i)
+      {
+        m_quads[i] = V2F_C4B_T2F_Quad();
+        SetQuadTexCoords(m_quads[i]);
+      }
+
+      counters::Add(counters::Counter::Quads, m_quadsPerBlock);
+
+      return block;
+    }
+
+    void QuadLayer::ReleaseBlock(BlockId block)
+    {
+      Block& b = m_blocks[block];
+      assert(b.used);
+
+      unsigned int first = GetQuadIndex(block, 0);
+      for (unsigned int i = first; i < first + m_quadsPerBlock; ++i)
+      {
+        m_tweens.Remove(i);
+      }
+
+      b.used = false;
+      b.visible = false;
+      m_freeBlocks.push_back(block);
+      counters::Add(counters::Counter::Quads, -static_cast<int64_t>(m_quadsPerBlock));
+    }
+
+    void QuadLayer::SetBlockVisible(BlockId block, bool visible)
+    {
+      Block& b = m_blocks[block];
+      assert(b.used);
+
+      if (b.visible == visible)
+        return;
+
+      b.visible = visible;
+    }
+
+    unsigned int QuadLayer::GetNumberOfBlocks() const
+    {
+      return m_blocks.size() - m_freeBlocks.size();
+    }
+
+    void QuadLayer::SetQuad(BlockId block, unsigned int slot, const Vec2& center, const Color4B& color, float scale)
+    {
+      unsigned int quad = GetQuadIndex(block, slot);
+      m_tweens.Remove(quad);
+      WriteQuad(quad, center, color, scale);
+    }
+
+    void QuadLayer::SetQuadColor(BlockId block, unsigned int slot, const Color4B& color)
+    {
+      unsigned int quad = GetQuadIndex(block, slot);
+      FillQuadColor(m_quads[quad], color);
+      MarkDirty(quad);
+    }
+
+    void QuadLayer::ClearQuad(BlockId block, unsigned int slot)
+    {
+      unsigned int quad = GetQuadIndex(block, slot);
+      m_tweens.Remove(quad);
+      PrepareClearQuad(block, slot);
+    }
+
+    void QuadLayer::PrepareQuad(BlockId block, unsigned int slot, const Vec2& center, const Color4B& color)
+    {
+      WriteQuad(GetQuadIndex(block, slot), center, color, 1.f);
+    }
+
+    void QuadLayer::PrepareClearQuad(BlockId block, unsigned int slot)
+    {
+      // degenerate quads are not rasterized
+      WriteQuad(GetQuadIndex(block, slot), Vec2::ZERO, Color4B(0, 0, 0, 0), 0.f);
+    }
+
+    void QuadLayer::StopTween(BlockId block, unsigned int slot)
+    {
+      unsigned int quad = GetQuadIndex(block, slot);
+      if (!m_tweens.IsRunning(quad))
+        return;
+
+      m_tweens.Remove(quad);
+      MoveQuad(quad, m_centers[quad]);
+    }
+
+    void QuadLayer::AnimateQuad(BlockId block, unsigned int slot, const Vec2& from, float duration)
+    {
+      if (duration <= 0.f)
+        return;
+
+      unsigned int quad = GetQuadIndex(block, slot);
+      m_tweens.Add(quad, from, m_centers[quad], m_time, duration);
+      MoveQuad(quad, from);
+    }
+
+    void QuadLayer::StopTweens(BlockId block)
+    {
+      for (unsigned int slot = 0; slot < m_quadsPerBlock; ++slot)
+      {
+        StopTween(block, slot);
+      }
+    }
+
+    void QuadLayer::update(float dt)
+    {
+      m_time += dt;
+
+      m_tweens.Advance(m_time);
+      for (unsigned int i = 0; i < m_tweens.GetSize(); ++i)
+      {
+        MoveQuad(m_tweens.GetTarget(i), m_tweens.GetPosition(i));
+      }
+      m_tweens.RemoveFinished();
+    }
+
+    void QuadLayer::draw(Renderer* renderer, const Mat4& transform, uint32_t flags)
+    {
+      m_customCommand.init(_globalZOrder, transform, flags);
+      m_customCommand.func = CC_CALLBACK_0(QuadLayer::onDraw, this, transform, flags);
+      renderer->addCommand(&m_customCommand);
+    }
+
+    void QuadLayer::onDraw(const Mat4& transform, uint32_t flags)
+    {
+      UploadVertices();
+
+      auto glProgram = getGLProgram();
+      glProgram->use();
+      glProgram->setUniformsForBuiltins(transform);
+
+      GL::blendFunc(m_blendFunc.src, m_blendFunc.dst);
+      GL::bindTexture2D(m_texture->getName());
+
+      if (Configuration::getInstance()->supportsShareableVAO())
+      {
+        GL::bindVAO(0);
+      }
+
+      GL::enableVertexAttribs(GL::VERTEX_ATTRIB_FLAG_POS_COLOR_TEX);
+      glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+
+      // runs of the visible blocks, split to fit the 16 bit indices
+      unsigned int firstQuad = 0;
+      unsigned int numberOfQuads = 0;
+      for (unsigned int i = 0; i < m_blocks.size(); ++i)
+      {
+        const Block& block = m_blocks[i];
+        bool visible = block.used && block.visible;
+        if (visible && numberOfQuads > 0 && numberOfQuads < m_quadsPerBatch)
+        {
+          numberOfQuads += m_quadsPerBlock;
+          continue;
+        }
+
+        DrawBatch(firstQuad, numberOfQuads);
+        firstQuad = GetQuadIndex(i, 0);
+        numberOfQuads = visible ? m_quadsPerBlock : 0;
+      }
+      DrawBatch(firstQuad, numberOfQuads);
+
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+      CHECK_GL_ERROR_DEBUG();
+    }
+
+    void QuadLayer::DrawBatch(unsigned int firstQuad, unsigned int numberOfQuads)
+    {
+      if (numberOfQuads == 0)
+        return;
+
+      assert(numberOfQuads <= m_quadsPerBatch);
+
+      // the indices start from zero, the attributes start from the first quad of the batch
+      size_t offset = sizeof(V2F_C4B_T2F_Quad) * firstQuad;
+      glVertexAttribPointer(GLProgram::VERTEX_ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE, sizeof(V2F_C4B_T2F), (GLvoid *)(offset + offsetof(V2F_C4B_T2F, vertices)));
+      glVertexAttribPointer(GLProgram::VERTEX_ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(V2F_C4B_T2F), (GLvoid *)(offset + offsetof(V2F_C4B_T2F, colors)));
+      glVertexAttribPointer(GLProgram::VERTEX_ATTRIB_TEX_COORD, 2, GL_FLOAT, GL_FALSE, sizeof(V2F_C4B_T2F), (GLvoid *)(offset + offsetof(V2F_C4B_T2F, texCoords)));
+
+      glDrawElements(GL_TRIANGLES, numberOfQuads * 6, GL_UNSIGNED_SHORT, 0);
+
+      CC_INCREMENT_GL_DRAWN_BATCHES_AND_VERTICES(1, numberOfQuads * 6);
+    }
+
+    unsigned int QuadLayer::GetQuadIndex(BlockId block, unsigned int slot) const
+    {
+      assert(block >= 0 && block < static_cast<BlockId>(m_blocks.size()));
+      assert(slot < m_quadsPerBlock);
+      return block * m_quadsPerBlock + slot;
+    }
+
+    unsigned int QuadLayer::GetQuadsPerBlock() const
+    {
+      return m_quadsPerBlock;
+    }
+
+    float QuadLayer::GetTime() const
+    {
+      return m_time;
+    }
+
+    void QuadLayer::WriteQuad(unsigned int quad, const Vec2& center, const Color4B& color, float scale)
+    {
+      m_centers[quad] = center;
+      m_halfSizes[quad] = m_halfSize * scale;
+      FillQuadColor(m_quads[quad], color);
+      MoveQuad(quad, center);
+    }
+
+    void QuadLayer::MoveQuad(unsigned int quad, const Vec2& center)
+    {
+      V2F_C4B_T2F_Quad& q = m_quads[quad];
+      float halfSize = m_halfSizes[quad];
+      q.bl.vertices = Vec2(center.x - halfSize, center.y - halfSize);
+      q.br.vertices = Vec2(center.x + halfSize, center.y - halfSize);
+      q.tl.vertices = Vec2(center.x - halfSize, center.y + halfSize);
+      q.tr.vertices = Vec2(center.x + halfSize, center.y + halfSize);
+      MarkDirty(quad);
+    }
+
+    void QuadLayer::MarkDirty(unsigned int quad)
+    {
+      Block& b = m_blocks[quad / m_quadsPerBlock];
+      unsigned int slot = quad % m_quadsPerBlock;
+      if (b.dirtyBegin >= b.dirtyEnd)
+      {
+        b.dirtyBegin = slot;
+        b.dirtyEnd = slot + 1;
+        return;
+      }
+
+      b.dirtyBegin = std::min(b.dirtyBegin, slot);
+      b.dirtyEnd = std::max(b.dirtyEnd, slot + 1);
+    }
+
+    void QuadLayer::UploadVertices()
+    {
+      glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+
+      if (m_bufferCapacity < m_quads.size())
+      {
+        m_bufferCapacity = std::max<unsigned int>(m_quads.size(), m_bufferCapacity * 2);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(V2F_C4B_T2F_Quad) * m_bufferCapacity, nullptr, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(V2F_C4B_T2F_Quad) * m_quads.size(), m_quads.data());
+
+        for (auto& block : m_blocks)
+        {
+          block.dirtyBegin = block.dirtyEnd = 0;
+        }
+      }
+      else
+      {
+        for (unsigned int i = 0; i < m_blocks.size(); ++i)
+        {
+          Block& block = m_blocks[i];
+          if (!block.used || block.dirtyBegin >= block.dirtyEnd)
+            continue;
+
+          unsigned int first = GetQuadIndex(i, block.dirtyBegin);
+          glBufferSubData(GL_ARRAY_BUFFER,
+                          sizeof(V2F_C4B_T2F_Quad) * first,
+                          sizeof(V2F_C4B_T2F_Quad) * (block.dirtyEnd - block.dirtyBegin),
+                          &m_quads[first]);
+          block.dirtyBegin = block.dirtyEnd = 0;
+        }
+      }
+
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void QuadLayer::CreateIndices()
+    {
+      std::vector<GLushort> indices;
+      indices.reserve(m_quadsPerBatch * 6);
+      for (unsigned int quad = 0; quad < m_quadsPerBatch; ++quad)
+      {
+        GLushort vertex = static_cast<GLushort>(quad * 4);
+        indices.push_back(vertex + 0);
+        indices.push_back(vertex + 1);
+        indices.push_back(vertex + 2);
+        indices.push_back(vertex + 3);
+        indices.push_back(vertex + 2);
+        indices.push_back(vertex + 1);
+      }
+
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * indices.size(), indices.data(), GL_STATIC_DRAW);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+  }
+}
@@ -0,0 +1,107 @@
+//
+//  QuadLayer.h
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "cocos2d.h"
+#include "TweenSystem.h"
+
+namespace jevo
+{
+  namespace graphic
+  {
+    // Colored quads of all the maps drawn by one call with one texture and shader.
+    // The vertex buffer is split into blocks of quadsPerBlock quads, every map owns a block and
+    // every cell of the map has a fixed quad (slot) in it. Quads are in the coordinates of the layer,
+    // only the changed ranges of the blocks go to the GPU.
+    // Indices are 16 bit (GLES2 has no 32 bit ones without an extension), so consecutive visible blocks
+    // are drawn by batches of at most kMaxBatchVertices vertices with one shared index buffer.
+    class QuadLayer : public cocos2d::Node
+    {
+    public:
+
+      using BlockId = int;
+      static const BlockId kInvalidBlock = -1;
+      static const unsigned int kMaxBatchVertices = 65536;
+
+      QuadLayer();
+      virtual ~QuadLayer();
+
+      bool init(const std::string& textureFileName, unsigned int quadsPerBlock, float quadSize);
+
+      virtual BlockId AllocateBlock();
+      virtual void ReleaseBlock(BlockId block);
+      // hidden blocks keep their quads but are not drawn
+      void SetBlockVisible(BlockId block, bool visible);
+      unsigned int GetNumberOfBlocks() const;
+
+      // scale is relative to the quadSize of the layer
+      void SetQuad(BlockId block, unsigned int slot, const cocos2d::Vec2& center, const cocos2d::Color4B& color, float scale = 1.f);
+      void SetQuadColor(BlockId block, unsigned int slot, const cocos2d::Color4B& color);
+      void ClearQuad(BlockId block, unsigned int slot);
+      // moves the quad from 'from' to the position set by SetQuad in duration seconds
+      void AnimateQuad(BlockId block, unsigned int slot, const cocos2d::Vec2& from, float duration);
+
+      // SetQuad and ClearQuad without stopping the tween of the quad, they are safe to call
+      // for different blocks at the same time. StopTween finishes them on the main thread
+      void PrepareQuad(BlockId block, unsigned int slot, const cocos2d::Vec2& center, const cocos2d::Color4B& color);
+      void PrepareClearQuad(BlockId block, unsigned int slot);
+      // the quad goes to the position set by SetQuad or PrepareQuad
+      void StopTween(BlockId block, unsigned int slot);
+      void StopTweens(BlockId block);
+
+      virtual void update(float dt) override;
+      virtual void draw(cocos2d::Renderer* renderer, const cocos2d::Mat4& transform, uint32_t flags) override;
+
+    protected:
+
+      unsigned int GetQuadIndex(BlockId block, unsigned int slot) const;
+      unsigned int GetQuadsPerBlock() const;
+      float GetTime() const;
+
+    private:
+
+      struct Block
+      {
+        bool used = false;
+        bool visible = false;
+        unsigned int dirtyBegin = 0; // changed slots [dirtyBegin, dirtyEnd)
+        unsigned int dirtyEnd = 0;
+      };
+
+      void onDraw(const cocos2d::Mat4& transform, uint32_t flags);
+      void WriteQuad(unsigned int quad, const cocos2d::Vec2& center, const cocos2d::Color4B& color, float scale);
+      void MoveQuad(unsigned int quad, const cocos2d::Vec2& center);
+      void MarkDirty(unsigned int quad);
+      void UploadVertices();
+      // indices of m_quadsPerBatch quads, they don't depend on the blocks
+      void CreateIndices();
+      void DrawBatch(unsigned int firstQuad, unsigned int numberOfQuads);
+
+      unsigned int m_quadsPerBlock = 0;
+      unsigned int m_quadsPerBatch = 0; // whole blocks
+      float m_halfSize = 0.f;
+
+      std::vector<cocos2d::V2F_C4B_T2F_Quad> m_quads;
+      std::vector<cocos2d::Vec2> m_centers;
+      std::vector<float> m_halfSizes;
+      std::vector<Block> m_blocks;
+      std::vector<BlockId> m_freeBlocks;
+      TweenSystem m_tweens; // targets are quads
+      float m_time = 0.f;
+
+      cocos2d::Texture2D* m_texture = nullptr;
+      cocos2d::BlendFunc m_blendFunc;
+      cocos2d::CustomCommand m_customCommand;
+      GLuint m_vbo = 0;
+      GLuint m_ibo = 0;
+      unsigned int m_bufferCapacity = 0; // quads allocated in m_vbo, it grows twice
+    };
+  }
+}
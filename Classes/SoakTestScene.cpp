@@ -0,0 +1,270 @@
+//
+//  SoakTestScene.cpp
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#include "SoakTestScene.h"
+#include "WorldModel.h"
+#include "UIConfig.h"
+#include "Logging.h"
+#include "Counters.h"
+#include "AppDelegate.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+#if (CC_TARGET_PLATFORM == CC_PLATFORM_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#elif (CC_TARGET_PLATFORM == CC_PLATFORM_MAC || CC_TARGET_PLATFORM == CC_PLATFORM_IOS)
+#include <mach/mach.h>
+#else
+#include <cstdio>
+#include <unistd.h>
+#endif
+
+USING_NS_CC;
+
+namespace jevo
+{
+  namespace ui
+  {
+    namespace
+    {
+      size_t GetResidentMemory()
+      {
+#if (CC_TARGET_PLATFORM == CC_PLATFORM_WIN32)
+        PROCESS_MEMORY_COUNTERS counters;
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+          return 0;
+        return counters.WorkingSetSize;
+#elif (CC_TARGET_PLATFORM == CC_PLATFORM_MAC || CC_TARGET_PLATFORM == CC_PLATFORM_IOS)
+        mach_task_basic_info info;
+        mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+        if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+          return 0;
+        return info.resident_size;
+#else
+        long pages = 0;
+        FILE* file = fopen("/proc/self/statm", "r");
+        if (!file)
+          return 0;
+        if (fscanf(file, "%*s %ld", &pages) != 1)
+          pages = 0;
+        fclose(file);
+        return pages * sysconf(_SC_PAGESIZE);
+#endif
+      }
+
+      float Seconds(const std::chrono::steady_clock::time_point& startTime)
+      {
+        std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - startTime;
+        return elapsed.count();
+      }
+    }
+
+    SoakTestScene::~SoakTestScene()
+    {
+      if (m_worldModel) m_worldModel->Stop();
+      if (m_rootNode) m_rootNode->release();
+    }
+
+    bool SoakTestScene::init(const std::string& workingFolder)
+    {
+      if ( !Layer::init() )
+      {
+        return false;
+      }
+
+      m_worldModel = std::make_shared<WorldModel>();
+      if (!m_worldModel->Init(workingFolder))
+      {
+        KOMORKI_LOG("SoakTest: no keyframe.json in %s", workingFolder.c_str());
+        return false;
+      }
+
+      m_rootNode = Node::create();
+      m_rootNode->retain();
+      addChild(m_rootNode);
+
+      Size visibleSize = Director::getInstance()->getVisibleSize();
+      m_viewport = std::make_shared<jevo::graphic::Viewport>(m_rootNode, visibleSize, m_worldModel);
+
+      KOMORKI_LOG("SoakTest: replaying %s", workingFolder.c_str());
+
+      scheduleUpdate();
+      return true;
+    }
+
+    void SoakTestScene::update(float dt)
+    {
+      m_time += dt;
+
+      MoveCamera(dt);
+
+      auto startTime = std::chrono::steady_clock::now();
+      unsigned int playedDiffs = m_viewport->UpdateAsync(dt);
+      m_updateTime += Seconds(startTime);
+      m_playedDiffs += playedDiffs;
+
+      startTime = std::chrono::steady_clock::now();
+      m_viewport->Calculate(dt);
+      m_viewport->UpdateFrame(dt);
+      m_frameUpdateTime += Seconds(startTime);
+      m_frames += 1;
+
+      m_idleTime = playedDiffs > 0 ? 0.f : m_idleTime + dt;
+      if (m_idleTime >= config::soakIdleTimeout && m_viewport->GetBacklog() == 0)
+      {
+        LogSample("done", TakeSample());
+        Finish(EXIT_SUCCESS);
+        return;
+      }
+
+      m_timeSinceSample += dt;
+      if (m_timeSinceSample < config::soakSampleInterval)
+        return;
+
+      Sample sample = TakeSample();
+      m_timeSinceSample = 0.f;
+      m_updateTime = 0.f;
+      m_frameUpdateTime = 0.f;
+      m_frames = 0;
+      m_playedDiffs = 0;
+
+      if (m_time < config::soakWarmupTime)
+      {
+        // the camera goes through all detail levels during the warmup, the baseline is the worst of them
+        UpdateBaseline(sample);
+        LogSample("warmup", sample);
+        return;
+      }
+
+      if (!m_hasBaseline)
+        return;
+
+      LogSample("sample", sample);
+      if (!CheckSample(sample))
+      {
+        Finish(EXIT_FAILURE);
+      }
+    }
+
+    SoakTestScene::Sample SoakTestScene::TakeSample() const
+    {
+      Sample sample;
+      sample.residentMemory = GetResidentMemory();
+      sample.partialMaps = counters::Get(counters::Counter::PartialMaps);
+      sample.spriteBatches = counters::Get(counters::Counter::SpriteBatches);
+      sample.organizms = counters::Get(counters::Counter::Organizms);
+      int64_t worldOrganizms = 0;
+      m_worldModel->m_map->ForEach([&worldOrganizms](const PixelPos&, const PixelPos&, const GreatPixel& pixel)
+                                   {
+                                     if (pixel.organizm) worldOrganizms += 1;
+                                   });
+      sample.detachedOrganizms = sample.organizms - worldOrganizms;
+      // the warp fills its time budget, so the time of a diff is compared, not the time of a frame
+      if (m_playedDiffs > 0)
+      {
+        sample.diffTime = m_updateTime / m_playedDiffs;
+      }
+      if (m_frames > 0)
+      {
+        sample.frameUpdateTime = m_frameUpdateTime / m_frames;
+      }
+      return sample;
+    }
+
+    void SoakTestScene::UpdateBaseline(const Sample& sample)
+    {
+      m_baseline.residentMemory = std::max(m_baseline.residentMemory, sample.residentMemory);
+      m_baseline.partialMaps = std::max(m_baseline.partialMaps, sample.partialMaps);
+      m_baseline.spriteBatches = std::max(m_baseline.spriteBatches, sample.spriteBatches);
+      m_baseline.organizms = std::max(m_baseline.organizms, sample.organizms);
+      m_baseline.detachedOrganizms = std::max(m_baseline.detachedOrganizms, sample.detachedOrganizms);
+      m_baseline.diffTime = std::max(m_baseline.diffTime, sample.diffTime);
+      m_baseline.frameUpdateTime = std::max(m_baseline.frameUpdateTime, sample.frameUpdateTime);
+      m_hasBaseline = true;
+    }
+
+    bool SoakTestScene::CheckSample(const Sample& sample) const
+    {
+      bool result = true;
+
+      if (sample.residentMemory > m_baseline.residentMemory * (1.f + config::soakMaxMemoryGrowth))
+      {
+        KOMORKI_LOG("SoakTest: FAILED resident memory %zu > %zu", sample.residentMemory, m_baseline.residentMemory);
+        result = false;
+      }
+
+      // loaded maps depend on the camera, cached ones are limited by config::mapCacheMaxMaps
+      int64_t maxMaps = m_baseline.partialMaps + config::mapCacheMaxMaps;
+      if (sample.partialMaps > maxMaps || sample.spriteBatches > maxMaps)
+      {
+        KOMORKI_LOG("SoakTest: FAILED maps %lld, sprite batches %lld > %lld",
+                    (long long)sample.partialMaps, (long long)sample.spriteBatches, (long long)maxMaps);
+        result = false;
+      }
+
+      // the organizms out of the world are held by the reported diffs only, the warp reports none
+      if (sample.detachedOrganizms > m_baseline.detachedOrganizms)
+      {
+        KOMORKI_LOG("SoakTest: FAILED organizms out of the world %lld > %lld",
+                    (long long)sample.detachedOrganizms, (long long)m_baseline.detachedOrganizms);
+        result = false;
+      }
+
+      if (sample.diffTime > m_baseline.diffTime * (1.f + config::soakMaxTimeGrowth) ||
+          sample.frameUpdateTime > m_baseline.frameUpdateTime * (1.f + config::soakMaxTimeGrowth))
+      {
+        KOMORKI_LOG("SoakTest: FAILED stage times %f, %f > %f, %f",
+                    sample.diffTime, sample.frameUpdateTime, m_baseline.diffTime, m_baseline.frameUpdateTime);
+        result = false;
+      }
+
+      return result;
+    }
+
+    void SoakTestScene::LogSample(const char* title, const Sample& sample) const
+    {
+      KOMORKI_LOG("SoakTest: %s time: %.0fs rss: %zuKB maps: %lld batches: %lld organizms: %lld detached: %lld diffs: %lld diff: %.3fus frame: %.2fms",
+                  title,
+                  m_time,
+                  sample.residentMemory / 1024,
+                  (long long)sample.partialMaps,
+                  (long long)sample.spriteBatches,
+                  (long long)sample.organizms,
+                  (long long)sample.detachedOrganizms,
+                  (long long)counters::Get(counters::Counter::DiffsApplied),
+                  sample.diffTime * 1000000.f,
+                  sample.frameUpdateTime * 1000.f);
+    }
+
+    void SoakTestScene::MoveCamera(float dt)
+    {
+      // circles over the world while zooming in and out, so the maps are loaded, cached
+      // and rebuilt on every detail level
+      m_cameraAngle += config::soakCameraAngularSpeed * dt;
+      cocos2d::Vec2 direction(std::cos(m_cameraAngle), std::sin(m_cameraAngle));
+      m_viewport->Move(direction * config::soakCameraSpeed * dt);
+
+      float scale = m_viewport->GetRootNode()->getScale();
+      float targetScale = config::initialScale * std::exp(config::soakZoomRange * std::sin(m_cameraAngle * 0.5f));
+      Size visibleSize = Director::getInstance()->getVisibleSize();
+      m_viewport->Zoom(cocos2d::Vec2(visibleSize.width / 2, visibleSize.height / 2), scale - targetScale);
+    }
+
+    void SoakTestScene::Finish(int exitCode)
+    {
+      // the scene and the Director are released by the main loop, main returns the code
+      unscheduleUpdate();
+      m_viewport->Destroy();
+      AppDelegate::SetExitCode(exitCode);
+      Director::getInstance()->end();
+    }
+  }
+}
@@ -0,0 +1,89 @@
+//
+//  SoakTestScene.h
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#pragma once
+
+#include <string>
+#include "Viewport.h"
+
+namespace jevo
+{
+  class WorldModel;
+
+  namespace ui
+  {
+    // Replays a folder in the warp mode while the camera circles over the world, the window is hidden.
+    // Every config::soakSampleInterval it logs the resident memory, object counts and stage timings,
+    // after config::soakWarmupTime they are compared with the maximum of the warmup and the application ends
+    // with 1 when one of them grows beyond its threshold. It ends with 0 when the folder is played.
+    class SoakTestScene: public cocos2d::Layer
+    {
+    public:
+      virtual bool init(const std::string& workingFolder);
+      virtual ~SoakTestScene();
+      static cocos2d::Scene* createScene(const std::string& workingFolder)
+      {
+        auto scene = cocos2d::Scene::create();
+
+        SoakTestScene *pRet = new(std::nothrow) SoakTestScene();
+        if (pRet && pRet->init(workingFolder))
+        {
+          pRet->autorelease();
+          scene->addChild(pRet);
+          return scene;
+        }
+        else
+        {
+          delete pRet;
+          pRet = NULL;
+          return NULL;
+        }
+      }
+
+      virtual void update(float dt) override;
+
+    private:
+
+      struct Sample
+      {
+        size_t residentMemory = 0; // bytes
+        int64_t partialMaps = 0;
+        int64_t spriteBatches = 0;
+        int64_t organizms = 0;
+        int64_t detachedOrganizms = 0; // alive but not in the world
+        float diffTime = 0.f; // average seconds per played diff
+        float frameUpdateTime = 0.f; // average seconds per frame spent on loading maps
+      };
+
+      Sample TakeSample() const;
+      void UpdateBaseline(const Sample& sample);
+      // returns false when the sample grew beyond the thresholds
+      bool CheckSample(const Sample& sample) const;
+      void LogSample(const char* title, const Sample& sample) const;
+      void MoveCamera(float dt);
+      void Finish(int exitCode);
+
+      std::shared_ptr<WorldModel> m_worldModel;
+      jevo::graphic::Viewport::Ptr m_viewport;
+      cocos2d::Node* m_rootNode = nullptr;
+
+      float m_time = 0.f;
+      float m_timeSinceSample = 0.f;
+      float m_idleTime = 0.f; // since the last played diff
+      float m_cameraAngle = 0.f;
+
+      // accumulated since the last sample
+      float m_updateTime = 0.f;
+      float m_frameUpdateTime = 0.f;
+      unsigned int m_frames = 0;
+      uint64_t m_playedDiffs = 0;
+
+      bool m_hasBaseline = false;
+      Sample m_baseline;
+    };
+  }
+}
@@ -6,6 +6,7 @@
 //
 
 #include "SpriteBatch.h"
+#include "Counters.h"
 
 USING_NS_CC;
 
@@ -13,16 +14,14 @@ namespace jevo
 {
   namespace graphic
   {
-    std::uint32_t SpriteBatch::instanceCounter = 0;
-    
     SpriteBatch::SpriteBatch()
     {
-      instanceCounter += 1;
+      counters::Add(counters::Counter::SpriteBatches);
     }
     
     SpriteBatch::~SpriteBatch()
     {
-      instanceCounter -= 1;
+      counters::Add(counters::Counter::SpriteBatches, -1);
     }
     
     Sprite* SpriteBatch::CreateSprite()
@@ -32,9 +31,11 @@ namespace jevo
       {
         s = m_spritesPull.front();
         m_spritesPull.pop_front();
+        counters::Add(counters::Counter::SpritePoolHits);
       }
       else
       {
+        counters::Add(counters::Counter::SpritePoolMisses);
         s = Sprite::createWithTexture(getTexture());
         addChild(s);
       }
@@ -19,8 +19,6 @@ namespace jevo
     {
     public:
       
-      static std::uint32_t instanceCounter;
-      
       SpriteBatch();
       virtual ~SpriteBatch();
       
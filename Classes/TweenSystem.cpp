@@ -0,0 +1,153 @@
+//
+//  TweenSystem.cpp
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#include "TweenSystem.h"
+
+namespace jevo
+{
+  namespace graphic
+  {
+    void TweenSystem::SetNumberOfTargets(unsigned int count)
+    {
+      assert(count >= m_targetIndex.size());
+      m_targetIndex.resize(count, -1);
+    }
+
+    void TweenSystem::Add(TargetId target, const cocos2d::Vec2& from, const cocos2d::Vec2& to, float startTime, float duration)
+    {
+      assert(target < m_targetIndex.size());
+      assert(duration > 0.f);
+
+      int index = m_targetIndex[target];
+      if (index < 0)
+      {
+        index = m_targets.size();
+        m_targetIndex[target] = index;
+        m_targets.push_back(target);
+        m_fromX.push_back(0.f);
+        m_fromY.push_back(0.f);
+        m_toX.push_back(0.f);
+        m_toY.push_back(0.f);
+        m_startTime.push_back(0.f);
+        m_duration.push_back(0.f);
+        m_progress.push_back(0.f);
+        m_x.push_back(0.f);
+        m_y.push_back(0.f);
+      }
+
+      m_fromX[index] = from.x;
+      m_fromY[index] = from.y;
+      m_toX[index] = to.x;
+      m_toY[index] = to.y;
+      m_startTime[index] = startTime;
+      m_duration[index] = duration;
+      m_progress[index] = 0.f;
+      m_x[index] = from.x;
+      m_y[index] = from.y;
+    }
+
+    void TweenSystem::Remove(TargetId target)
+    {
+      assert(target < m_targetIndex.size());
+
+      int index = m_targetIndex[target];
+      if (index < 0)
+        return;
+
+      RemoveAt(index);
+    }
+
+    bool TweenSystem::IsRunning(TargetId target) const
+    {
+      return target < m_targetIndex.size() && m_targetIndex[target] >= 0;
+    }
+
+    void TweenSystem::Advance(float time)
+    {
+      const unsigned int size = m_targets.size();
+      const float* fromX = m_fromX.data();
+      const float* fromY = m_fromY.data();
+      const float* toX = m_toX.data();
+      const float* toY = m_toY.data();
+      const float* startTime = m_startTime.data();
+      const float* duration = m_duration.data();
+      float* progress = m_progress.data();
+      float* x = m_x.data();
+      float* y = m_y.data();
+
+      // no branches and no aliasing between the arrays, the compiler vectorizes it
+      for (unsigned int i = 0; i < size; ++i)
+      {
+        float t = (time - startTime[i]) / duration[i];
+        t = std::min(std::max(t, 0.f), 1.f);
+        progress[i] = t;
+        x[i] = fromX[i] + (toX[i] - fromX[i]) * t;
+        y[i] = fromY[i] + (toY[i] - fromY[i]) * t;
+      }
+    }
+
+    unsigned int TweenSystem::GetSize() const
+    {
+      return m_targets.size();
+    }
+
+    TweenSystem::TargetId TweenSystem::GetTarget(unsigned int index) const
+    {
+      return m_targets[index];
+    }
+
+    cocos2d::Vec2 TweenSystem::GetPosition(unsigned int index) const
+    {
+      return cocos2d::Vec2(m_x[index], m_y[index]);
+    }
+
+    void TweenSystem::RemoveFinished()
+    {
+      unsigned int i = m_targets.size();
+      while (i > 0)
+      {
+        i -= 1;
+        if (m_progress[i] >= 1.f)
+        {
+          RemoveAt(i);
+        }
+      }
+    }
+
+    void TweenSystem::RemoveAt(unsigned int index)
+    {
+      m_targetIndex[m_targets[index]] = -1;
+
+      unsigned int last = m_targets.size() - 1;
+      if (index != last)
+      {
+        m_targets[index] = m_targets[last];
+        m_fromX[index] = m_fromX[last];
+        m_fromY[index] = m_fromY[last];
+        m_toX[index] = m_toX[last];
+        m_toY[index] = m_toY[last];
+        m_startTime[index] = m_startTime[last];
+        m_duration[index] = m_duration[last];
+        m_progress[index] = m_progress[last];
+        m_x[index] = m_x[last];
+        m_y[index] = m_y[last];
+        m_targetIndex[m_targets[index]] = index;
+      }
+
+      m_targets.pop_back();
+      m_fromX.pop_back();
+      m_fromY.pop_back();
+      m_toX.pop_back();
+      m_toY.pop_back();
+      m_startTime.pop_back();
+      m_duration.pop_back();
+      m_progress.pop_back();
+      m_x.pop_back();
+      m_y.pop_back();
+    }
+  }
+}
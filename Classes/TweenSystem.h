@@ -0,0 +1,58 @@
+//
+//  TweenSystem.h
+//  Komorki
+//
+//  Created on 19.10.26.
+//
+
+#pragma once
+
+#include <vector>
+#include "cocos2d.h"
+
+namespace jevo
+{
+  namespace graphic
+  {
+    // Linear moves of many targets (e.g. quads). Every tween is a row in flat arrays,
+    // all of them are advanced in one pass per frame without allocations.
+    class TweenSystem
+    {
+    public:
+
+      using TargetId = unsigned int;
+
+      // targets are [0, count)
+      void SetNumberOfTargets(unsigned int count);
+      // replaces the running tween of the target
+      void Add(TargetId target, const cocos2d::Vec2& from, const cocos2d::Vec2& to, float startTime, float duration);
+      void Remove(TargetId target);
+      bool IsRunning(TargetId target) const;
+
+      // calculates the positions at the time, read them with GetTarget/GetPosition
+      void Advance(float time);
+      unsigned int GetSize() const;
+      TargetId GetTarget(unsigned int index) const;
+      cocos2d::Vec2 GetPosition(unsigned int index) const;
+      // drops the tweens which reached the end in the last Advance
+      void RemoveFinished();
+
+    private:
+
+      void RemoveAt(unsigned int index);
+
+      std::vector<TargetId> m_targets;
+      std::vector<float> m_fromX;
+      std::vector<float> m_fromY;
+      std::vector<float> m_toX;
+      std::vector<float> m_toY;
+      std::vector<float> m_startTime;
+      std::vector<float> m_duration;
+      std::vector<float> m_progress;
+      std::vector<float> m_x;
+      std::vector<float> m_y;
+
+      std::vector<int> m_targetIndex; // row of the target or -1
+    };
+  }
+}
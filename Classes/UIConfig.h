@@ -31,8 +31,37 @@ namespace jevo
     const std::string workingFolder = cocos2d::FileUtils::getInstance()->getWritablePath() + "Jevo";
 #endif
     const float initialScale = 0.1;
-    const unsigned int numberOfUpdatesPerTick = 100;
-    const float updateTime = 0.04;
+    const unsigned int numberOfUpdatesPerTick = 100; // diffs per tick when the player keeps up with the reader
+    const float updateTime = 0.04; // seconds of a tick at the normal speed
+    const float targetFrameTime = 1.f / 60.f;
+    const float minWorkTimePerFrame = 0.002f; // seconds of a frame always given to playing diffs
+    const unsigned int minUpdatesPerTick = 10;
+    const unsigned int maxTicksPerFrame = 4; // the rest of the accumulated time is dropped
+    const float backlogDrainTime = 2.f; // seconds to play the diffs which are read but not played
+    const float pacingSmoothing = 0.1f;
+    const float warpWorkTimePerFrame = 0.012f; // seconds of a frame spent on playing diffs in the warp mode
+    const unsigned int warpUpdatesPerStep = 2000;
+    const unsigned int applyStripeRows = 100; // rows of the world played by one job, a multiple of SparseWorld::kChunkSize
+    const unsigned int stripedUpdatesMinDiffs = 500; // fewer diffs are played serially
+    const float warpSyncInterval = 0.1f; // seconds between syncs of the maps with the world in the warp mode
+    const unsigned int profilerEventsPerThread = 65536; // ring buffer of the zones of a thread
+    const std::string profilerTraceFileName = "trace.json"; // in the writable path
+    const float countersSampleInterval = 1.f; // seconds
+    const unsigned int countersMaxFileSize = 8 * 1024 * 1024; // bytes, then the file is rolled over
+    const std::string countersFileName = "counters.csv"; // in the writable path
+    const float soakSampleInterval = 10.f; // seconds
+    const float soakWarmupTime = 120.f; // seconds before the baseline sample
+    const float soakIdleTimeout = 30.f; // seconds without diffs to consider the folder played
+    const float soakMaxMemoryGrowth = 0.5f; // relative to the baseline
+    const float soakMaxTimeGrowth = 2.f; // relative to the baseline
+    const float soakCameraSpeed = 300.f; // points per second
+    const float soakCameraAngularSpeed = 0.3f; // radians per second
+    const float soakZoomRange = 1.7f; // log of the scale around initialScale
+    const std::string cameraPathFileName = "camera_path.json"; // in the writable path
+    const float cameraPathFrameTime = 1.f / 60.f; // seconds of the path played per frame
+    const float cameraPathReaderTimeout = 10.f; // seconds to wait for the diffs of the path
+    const int benchmarkGridSize = 4096; // cells on a side
+    const unsigned int benchmarkRuns = 5;
     const bool healthCheck = false;
     const bool removeFiles = false;
     const bool randomColorPerPartialMap = false;
@@ -41,6 +70,27 @@ namespace jevo
     
     const uint8_t fadeInitialOpacity = 100;
     const float fadeDuration = 2.f; // seconds
+    const uint8_t alertInitialOpacity = 130;
+    const float alertDuration = 5.f; // seconds
+    const unsigned int effectsPerMap = 256; // ring buffer of fades and alerts of a map
+    const unsigned int effectsBudget = 4096; // fades and alerts of all maps
+    const float energyAlertStep = 0.1f; // seconds between the fading steps of the energy alerts
+    const unsigned int jobWorkers = 0; // threads of the JobSystem besides the main one, 0 is a thread per other core
+    
+    const float overviewScale = 0.02; // below this scale the world is drawn from the color pyramid
+    // detail levels of the viewport, points per cell on the screen
+    const float detailFullCellSize = 7.f; // above this size moves are animated and the effects are shown
+    const float detailSpritesCellSize = 3.f; // above this size every cell is a quad, below it maps are textures
+    const float detailHysteresis = 0.15f; // relative margin to cross before leaving a detail level
+    const int textureSegmentFactor = 4; // texture maps are this many times wider than the quad maps, twice as wide per halving of the cell size
+    const unsigned int pyramidMaxTextureSize = 2048;
+    const unsigned int minimapSize = 200; // points
+    const float chunkMaterializationBudget = 0.004f; // seconds per frame spent on creating organizms of new maps
+    const float prefetchLookahead = 0.5f; // seconds of camera motion loaded ahead of the visible rect
+    const float prefetchVelocitySmoothing = 0.5f;
+    const unsigned int prefetchChunkBudget = 12; // maps loaded beyond the visible rect because of the camera motion
+    const unsigned int mapCacheMaxMaps = 32; // maps kept off the screen after they leave the loaded rect
+    const unsigned int mapCacheQuadBudget = 80000; // cell quads and effect sprites kept alive by the cached maps
   }
 }
 
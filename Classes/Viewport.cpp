@@ -5,6 +5,9 @@
 #include "UIConfig.h"
 #include "UICommon.h"
 #include "Logging.h"
+#include "Profiler.h"
+#include "JobSystem.h"
+#include <chrono>
 
 
 namespace jevo
@@ -109,22 +112,27 @@ namespace jevo
       float newSuperViewScale;
       graphic::Zoom(m_superView->getPosition(), point, m_superView->getScale(), scaleOffset, newSuperViewPos, newSuperViewScale);
       
-      if (newSuperViewScale < 0.02 || newSuperViewScale > 0.6)
+      // allow to zoom out until the whole world fits into the screen
+      Vec2 worldSize = m_worldModel->GetSize();
+      float fitScale = std::min(tt_viewSize.width / (worldSize.x * kSpritePosition),
+                                tt_viewSize.height / (worldSize.y * kSpritePosition));
+      float minScale = std::min(config::overviewScale, fitScale * 0.5f);
+      
+      if (newSuperViewScale < minScale || newSuperViewScale > 0.6)
         return;
       
       m_superView->setPosition(newSuperViewPos);
       m_superView->setScale(newSuperViewScale);
     }
 
-    void Viewport::Calculate()
+    void Viewport::Calculate(float dt)
     {
-      auto graphicalVisibleRect = GetCurrentGraphicRect();
+      UpdateVelocity(dt);
 
-      Rect pixelRect = TTPixelRect(graphicalVisibleRect);
-      Rect innerPrevRect = ResizeByStep(tt_loadedPixelRect, pixelRect, kSegmentSize);
-      Rect extendedRect = ExtendRectWithStep(innerPrevRect, pixelRect, kSegmentSize);
-      Vec2 size = m_worldModel->GetSize();
-      extendedRect = extendedRect.Extract({Vec2(0, 0), size});
+      if (m_detailLevel == DetailLevel::Overview)
+        return;
+      
+      Rect extendedRect = GetRectToLoad();
 
       if ( extendedRect != tt_loadedPixelRect && extendedRect.size != Vec2())
       {
@@ -148,13 +156,46 @@ namespace jevo
       m_superView->addChild(m_lightNode);
       m_superView->addChild(m_mainView);
       m_performMove = false;
+      m_detailLevel = DetailLevel::Full;
+      m_textureStep = 0;
+      m_mapSegmentSize = kSegmentSize;
+      m_hasViewSample = false;
+      m_warpMode = false;
+      m_warpSyncTime = 0.f;
+      m_prevLogScale = 0.f;
+      m_zoomVelocity = 0.f;
 
       m_worldModel = worldModel;
+      
+      m_colorPyramid = std::make_shared<ColorPyramid>();
+      if (m_colorPyramid->Init(*m_worldModel))
+      {
+        m_worldModel->m_colorPyramid = m_colorPyramid;
+      }
+      
+      m_overviewSprite = cocos2d::Sprite::create();
+      m_overviewSprite->setAnchorPoint({0, 0});
+      m_overviewSprite->setFlippedY(true);
+      m_overviewSprite->setVisible(false);
+      m_superView->addChild(m_overviewSprite, -1);
 
       m_mapManager.m_mainNode = m_mainView;
       m_mapManager.m_lightNode = m_lightNode;
       m_mapManager.m_worldModel = worldModel;
+      m_mapManager.Init();
       m_mainView->setName("SuperView");
+      
+      // the texture maps double their size each time the cell size halves, so about the same number
+      // of them is on the screen. A texture step spans at least a halving of the cell size
+      const float overviewCellSize = config::overviewScale * kSpritePosition;
+      m_detailThresholds = {config::detailFullCellSize, config::detailSpritesCellSize};
+      for (float cellSize = config::detailSpritesCellSize / 2; cellSize >= overviewCellSize * 2; cellSize /= 2)
+      {
+        m_detailThresholds.push_back(cellSize);
+      }
+      m_detailThresholds.push_back(overviewCellSize);
+      
+      SetDetailStep(SelectDetailStep(m_superView->getScale() * kSpritePosition));
 
       CreateMap();
 
@@ -324,16 +365,17 @@ namespace jevo
       PerformMove(newMaps, mapsToRemove);
 
       m_mapManager.m_visibleArea = tt_loadedPixelRect;
-      WorldModelDiffVect worldUpdateResult;
+      WorldModelDiffBuckets worldUpdateResult;
       m_mapManager.Update(newMaps, mapsToRemove, worldUpdateResult, 0);
 
-      auto currentMaps = m_mapManager.GetMaps();
+      const Maps& currentMaps = m_mapManager.GetMaps();
       for (const auto& m : currentMaps)
       {
         Vec2 pos = m.first - tt_loadedPixelRect.origin;
         m.second->Transfrorm(cocos2d::Vec2(pos.x, pos.y) * kSpritePosition,
                              1.f);
       }
+      m_mapManager.SetLoadedOrigin(tt_loadedPixelRect.origin);
     }
 
     void Viewport::Resize(const cocos2d::Size& size)
@@ -342,8 +384,54 @@ namespace jevo
       m_performMove = true;
     }
 
-    void Viewport::UpdateAsync(float& updateTime)
+    void Viewport::UpdateFrame(float dt)
+    {
+      if (m_detailLevel == DetailLevel::Overview)
+        return;
+      
+      Rect visibleRect = GetVisiblePixelRect();
+      m_mapManager.m_focusPoint = visibleRect.origin + visibleRect.size / 2;
+      m_mapManager.MaterializePendingMaps(config::chunkMaterializationBudget);
+    }
+
+    unsigned int Viewport::UpdateAsync(float dt)
     {
+      // warp: the diffs are played as fast as the reader supplies them within the frame budget,
+      // nothing is reported for the maps, they are synced from the world a few times per second
+      auto startTime = std::chrono::steady_clock::now();
+      unsigned int playedUpdates = 0;
+      m_worldUpdateResult.Clear();
+      while (true)
+      {
+        unsigned int played = m_worldModel->PlayUpdates(config::warpUpdatesPerStep, tt_loadedPixelRect, m_worldUpdateResult, false);
+        playedUpdates += played;
+        
+        std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - startTime;
+        if (played == 0 || elapsed.count() >= config::warpWorkTimePerFrame)
+          break;
+      }
+      assert(m_worldUpdateResult.Empty());
+      
+      JobGraph frame;
+      frame.Add([this]()
+                {
+                  m_colorPyramid->Calculate(*m_worldModel);
+                });
+      
+      UpdateMaps(0);
+      
+      m_warpSyncTime += dt;
+      if (!m_warpMode || m_warpSyncTime >= config::warpSyncInterval)
+      {
+        m_mapManager.Resync();
+        m_warpSyncTime = 0.f;
+      }
+      m_warpMode = true;
+      
+      frame.Wait();
+      m_colorPyramid->Upload();
+      
+      return playedUpdates;
     }
 
     bool Viewport::IsAvailable()
@@ -353,7 +441,7 @@ namespace jevo
     
     bool Viewport::Destroy()
     {
-      m_worldUpdateResult.clear();
+      m_worldUpdateResult.Clear();
       m_worldModel->Stop();
       return false;
     }
@@ -373,64 +461,193 @@ namespace jevo
       return m_lightNode;
     }
 
-    void Viewport::Update(float updateTime, float& outUpdateTime)
+    const ColorPyramid::Ptr& Viewport::GetColorPyramid() const
     {
-      m_worldUpdateResult.clear();
-      m_worldModel->PlayUpdates(config::numberOfUpdatesPerTick, tt_loadedPixelRect, m_worldUpdateResult);
+      return m_colorPyramid;
+    }
 
-      PartialMapsManager::RemoveMapArgs mapsToRemove;
-      PartialMapsManager::CreateMapArgs newMaps;
+    Rect Viewport::GetVisiblePixelRect() const
+    {
+      return TTPixelRect(GetCurrentGraphicRect());
+    }
 
-      bool enableAnimations = m_mapManager.m_enableAnimations;
-      bool enableFancyAnimaitons = m_mapManager.m_enableFancyAnimaitons;
-      float greatPixelSize = m_superView->getScale() * kSpritePosition;
-      if (greatPixelSize >= 7.f)
-      {
-        enableAnimations = true;
-        enableFancyAnimaitons = true;
-      }
-      else if (greatPixelSize >= 3.f)
+    size_t Viewport::GetBacklog() const
+    {
+      return m_worldModel->GetBacklog();
+    }
+
+    const std::shared_ptr<jevo::WorldModel>& Viewport::GetWorldModel() const
+    {
+      return m_worldModel;
+    }
+
+    cocos2d::Vec2 Viewport::GetCameraOrigin() const
+    {
+      return GetCurrentGraphicRect().origin;
+    }
+
+    void Viewport::SetCamera(const cocos2d::Vec2& origin, float scale)
+    {
+      // inverse of GetCurrentGraphicRect
+      cocos2d::Vec2 loadedOrigin = FromPixels(tt_loadedPixelRect.origin) * kSpritePosition;
+      m_superView->setScale(scale);
+      m_superView->setPosition((loadedOrigin - origin) * scale);
+      m_performMove = true;
+    }
+
+    unsigned int Viewport::Update(float updateTime, unsigned int numberOfUpdates)
+    {
+      m_worldUpdateResult.Clear();
+      unsigned int playedUpdates = m_worldModel->PlayUpdates(numberOfUpdates, tt_loadedPixelRect, m_worldUpdateResult);
+      
+      // the pyramid is calculated on a worker while the maps are updated, both only read the world
+      JobGraph frame;
+      frame.Add([this]()
+                {
+                  m_colorPyramid->Calculate(*m_worldModel);
+                });
+      
+      if (m_warpMode)
       {
-        enableAnimations = true;
-        enableFancyAnimaitons = false;
+        // the cells changed since the last sync of the warp are not covered by the diffs
+        m_mapManager.Resync();
+        m_warpMode = false;
       }
-      else
+      
+      UpdateMaps(updateTime);
+      
+      frame.Wait();
+      m_colorPyramid->Upload();
+      
+      return playedUpdates;
+    }
+
+    void Viewport::UpdateMaps(float updateTime)
+    {
+      PartialMapsManager::RemoveMapArgs mapsToRemove;
+      PartialMapsManager::CreateMapArgs newMaps;
+      
+      unsigned int detailStep = SelectDetailStep(m_superView->getScale() * kSpritePosition);
+      if (detailStep != GetDetailStep())
       {
-        enableAnimations = false;
-        enableFancyAnimaitons = false;
+        SetDetailStep(detailStep);
       }
       
-      if (m_performMove)
+      // the overview draws no maps, SetDetailLevel moves them again when a map level is selected
+      bool performMove = m_performMove && m_detailLevel != DetailLevel::Overview;
+      if (performMove)
       {
         PerformMove(newMaps, mapsToRemove);
       }
 
-      m_mapManager.EnableAnimation(enableAnimations, enableFancyAnimaitons);
       m_mapManager.m_visibleArea = tt_loadedPixelRect;
       m_mapManager.Update(newMaps, mapsToRemove, m_worldUpdateResult, updateTime);
 
-      if (m_performMove)
+      if (performMove)
       {
-        auto currentMaps = m_mapManager.GetMaps();
+        const Maps& currentMaps = m_mapManager.GetMaps();
         for (const auto& m : currentMaps)
         {
           Vec2 pos = m.first - tt_loadedPixelRect.origin;
           m.second->Transfrorm(cocos2d::Vec2(pos.x, pos.y) * kSpritePosition, 1.f);
         }
+        m_mapManager.SetLoadedOrigin(tt_loadedPixelRect.origin);
         m_performMove = false;
       }
+      
+      if (m_detailLevel == DetailLevel::Overview)
+      {
+        UpdateOverviewSprite();
+      }
+    }
+
+    unsigned int Viewport::GetDetailStep() const
+    {
+      if (m_detailLevel == DetailLevel::Overview)
+        return static_cast<unsigned int>(m_detailThresholds.size());
+      return static_cast<unsigned int>(m_detailLevel) + m_textureStep;
+    }
+    
+    unsigned int Viewport::SelectDetailStep(float cellSize) const
+    {
+      const unsigned int coarsest = static_cast<unsigned int>(m_detailThresholds.size());
+      const float margin = config::detailHysteresis;
+      
+      // a step is left only when the cell size is past the threshold by the margin,
+      // zooming around a threshold doesn't rebuild the maps on every frame
+      unsigned int step = GetDetailStep();
+      while (step < coarsest && cellSize < m_detailThresholds[step] * (1.f - margin))
+      {
+        step += 1;
+      }
+      while (step > 0 && cellSize > m_detailThresholds[step - 1] * (1.f + margin))
+      {
+        step -= 1;
+      }
+      return step;
+    }
+
+    void Viewport::SetDetailStep(unsigned int step)
+    {
+      LOG_W("%s %u -> %u", __FUNCTION__, GetDetailStep(), step);
+      
+      const unsigned int texture = static_cast<unsigned int>(DetailLevel::Texture);
+      bool wasOverview = m_detailLevel == DetailLevel::Overview;
+      if (step >= m_detailThresholds.size())
+      {
+        m_detailLevel = DetailLevel::Overview;
+        m_textureStep = 0;
+      }
+      else
+      {
+        m_detailLevel = static_cast<DetailLevel>(std::min(step, texture));
+        m_textureStep = step - std::min(step, texture);
+      }
+      m_overviewSprite->setVisible(m_detailLevel == DetailLevel::Overview);
+      
+      m_mapManager.EnableAnimation(m_detailLevel <= DetailLevel::Sprites, m_detailLevel == DetailLevel::Full);
+      m_mapManager.m_enableEffects = m_detailLevel == DetailLevel::Full;
+      
+      // sprites don't make sense when an organizm is a couple of pixels on the screen,
+      // coarser levels draw bigger maps so the number of nodes stays about the same
+      RenderMode renderMode = m_detailLevel <= DetailLevel::Sprites ? RenderMode::Sprites : RenderMode::Texture;
+      int segmentSize = renderMode == RenderMode::Sprites ? kSegmentSize : (kSegmentSize * config::textureSegmentFactor) << m_textureStep;
+      bool overview = m_detailLevel == DetailLevel::Overview;
+      
+      if (renderMode == m_mapManager.m_renderMode && segmentSize == m_mapSegmentSize &&
+          !overview && !wasOverview)
+        return;
+      
+      // the maps are split on chunks of the new size, everything is loaded again
+      m_mapSegmentSize = segmentSize;
+      m_mapManager.Reset(renderMode, segmentSize);
+      tt_loadedPixelRect.size = Vec2();
+      m_performMove = !overview;
+    }
+
+    void Viewport::UpdateOverviewSprite()
+    {
+      float cellSize = m_superView->getScale() * kSpritePosition;
+      unsigned int level = m_colorPyramid->GetLevelForTexelSize(1.f / cellSize);
+      cocos2d::Texture2D* texture = m_colorPyramid->GetTexture(level);
+      
+      if (m_overviewSprite->getTexture() != texture)
+      {
+        m_overviewSprite->setTexture(texture);
+        cocos2d::Size textureSize = texture->getContentSize();
+        m_overviewSprite->setTextureRect(cocos2d::Rect(0, 0, textureSize.width, textureSize.height));
+      }
+      
+      m_overviewSprite->setScale((1 << level) * kSpritePosition);
+      m_overviewSprite->setPosition(-FromPixels(tt_loadedPixelRect.origin) * kSpritePosition);
     }
 
     void Viewport::PerformMove(PartialMapsManager::CreateMapArgs& newMapsArgs,
                                PartialMapsManager::RemoveMapArgs& mapsToRemove)
     {
-      auto graphicalVisibleRect = GetCurrentGraphicRect();
-
-      Rect pixelRect = TTPixelRect(graphicalVisibleRect);
-      Rect innerPrevRect = ResizeByStep(tt_loadedPixelRect, pixelRect, kSegmentSize);
-      Rect extendedRect = ExtendRectWithStep(innerPrevRect, pixelRect, kSegmentSize);
-      Vec2 size = m_worldModel->GetSize();
-      extendedRect = extendedRect.Extract({Vec2(0, 0), size});
+      PROFILE_ZONE("Viewport::PerformMove");
+      
+      Rect extendedRect = GetRectToLoad();
       
       if ( extendedRect == tt_loadedPixelRect || extendedRect.size == Vec2())
         return;
@@ -446,7 +663,7 @@ namespace jevo
       
 
       // remove maps out of visible rect
-      auto currentMaps = m_mapManager.GetMaps();
+      const Maps& currentMaps = m_mapManager.GetMaps();
       bool res = RemoveMapsOutsideOfRect(extendedRect, currentMaps, mapsToRemove);
 
       // get new maps to create
@@ -459,6 +676,78 @@ namespace jevo
                                newMapsArgs);
     }
 
+    Rect Viewport::GetRectToLoad() const
+    {
+      auto graphicalVisibleRect = GetCurrentGraphicRect();
+
+      Rect pixelRect = GetPrefetchRect(TTPixelRect(graphicalVisibleRect));
+      Rect innerPrevRect;
+      if (tt_loadedPixelRect.size == Vec2())
+      {
+        // nothing is loaded, grow from the chunk under the visible origin
+        Vec2 origin(std::max(pixelRect.origin.x, 0), std::max(pixelRect.origin.y, 0));
+        innerPrevRect = Rect(GetMapOriginFromPos(origin, m_mapSegmentSize), Vec2());
+      }
+      else
+      {
+        innerPrevRect = ResizeByStep(tt_loadedPixelRect, pixelRect, m_mapSegmentSize);
+      }
+      Rect extendedRect = ExtendRectWithStep(innerPrevRect, pixelRect, m_mapSegmentSize);
+      Vec2 size = m_worldModel->GetSize();
+      return extendedRect.Extract({Vec2(0, 0), size});
+    }
+
+    Rect Viewport::GetPrefetchRect(const Rect& visibleRect) const
+    {
+      // zooming out grows the visible area by exp(-zoomVelocity * lookahead) in each dimension
+      float lookahead = config::prefetchLookahead;
+      float growth = std::exp(std::max(0.f, -m_zoomVelocity) * lookahead) - 1.f;
+      cocos2d::Vec2 extend(visibleRect.size.x * growth * 0.5f, visibleRect.size.y * growth * 0.5f);
+      cocos2d::Vec2 shift = m_panVelocity * lookahead;
+
+      // keep the cells loaded ahead of the camera within the budget
+      float width = visibleRect.size.x;
+      float height = visibleRect.size.y;
+      float extraArea = (width + 2.f * extend.x + std::abs(shift.x)) * (height + 2.f * extend.y + std::abs(shift.y)) - width * height;
+      float budget = config::prefetchChunkBudget * m_mapSegmentSize * m_mapSegmentSize;
+      if (extraArea > budget)
+      {
+        float ratio = budget / extraArea;
+        extend *= ratio;
+        shift *= ratio;
+      }
+
+      PixelPos left = std::floor(std::min(shift.x, 0.f) - extend.x);
+      PixelPos right = std::ceil(std::max(shift.x, 0.f) + extend.x);
+      PixelPos bottom = std::floor(std::min(shift.y, 0.f) - extend.y);
+      PixelPos top = std::ceil(std::max(shift.y, 0.f) + extend.y);
+
+      Rect result = visibleRect;
+      result.origin += Vec2(left, bottom);
+      result.size += Vec2(right - left, top - bottom);
+      return result;
+    }
+
+    void Viewport::UpdateVelocity(float dt)
+    {
+      auto graphicRect = GetCurrentGraphicRect();
+      cocos2d::Vec2 center(graphicRect.getMidX() / kSpritePosition, graphicRect.getMidY() / kSpritePosition);
+      float logScale = std::log(m_superView->getScale());
+
+      if (m_hasViewSample && dt > 0.f)
+      {
+        float smoothing = config::prefetchVelocitySmoothing;
+        cocos2d::Vec2 panVelocity = (center - m_prevViewCenter) / dt;
+        float zoomVelocity = (logScale - m_prevLogScale) / dt;
+        m_panVelocity = m_panVelocity.lerp(panVelocity, smoothing);
+        m_zoomVelocity += (zoomVelocity - m_zoomVelocity) * smoothing;
+      }
+
+      m_prevViewCenter = center;
+      m_prevLogScale = logScale;
+      m_hasViewSample = true;
+    }
+
     bool Viewport::RemoveMapsOutsideOfRect(const Rect& rect,
                                            const Maps& currentMaps,
                                            PartialMapsManager::RemoveMapArgs& mapsToRemove)
@@ -483,7 +772,7 @@ namespace jevo
 
     bool Viewport::SplitRectOnChunks(const Rect& rect, const Rect& existingRect, std::vector<Rect>& result) const
     {
-      return jevo::SplitRectOnChunks(rect, existingRect, kSegmentSize, result);
+      return jevo::SplitRectOnChunks(rect, existingRect, m_mapSegmentSize, result);
     }
 
     bool Viewport::FillCreateMapsArgs(const std::vector<Rect>& rects,
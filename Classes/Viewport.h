@@ -5,6 +5,7 @@
 #include "Common.h"
 #include "WorldModel.h"
 #include "PartialMapsManager.h"
+#include "ColorPyramid.h"
 
 namespace jevo
 {
@@ -14,6 +15,15 @@ namespace jevo
   {
     class PartialMap;
 
+    // what the viewport draws depending on the size of a cell on the screen, from the finest to the coarsest
+    enum class DetailLevel
+    {
+      Full,     // a quad per cell, animated moves, fades and alerts
+      Sprites,  // a quad per cell, animated moves, no effects
+      Texture,  // a texture per map, the maps get wider as the cells get smaller, see config::textureSegmentFactor
+      Overview  // no maps, the whole world is drawn from the color pyramid
+    };
+
     class Viewport
     {
     public:
@@ -22,7 +32,8 @@ namespace jevo
 
       void Move(const cocos2d::Vec2& ofset);
       void Zoom(const cocos2d::Vec2& point, float scaleOffset);
-      void Calculate();
+      // dt is the time since the previous call, it is used to track the camera velocity
+      void Calculate(float dt);
 
       Viewport(cocos2d::Node* superView,
                const cocos2d::Size& originalSize,
@@ -33,23 +44,46 @@ namespace jevo
       void CreateMap();
       void Resize(const cocos2d::Size& originalSize);
 
-      void Update(float updateTime, float& outUpdateTime);
-      void UpdateAsync(float& updateTime);
+      // plays up to numberOfUpdates diffs, updateTime is the animation time, returns the number of played diffs
+      unsigned int Update(float updateTime, unsigned int numberOfUpdates);
+      void UpdateFrame(float dt);
+      // warp mode, plays diffs without animations as fast as they are read, returns the number of played diffs
+      unsigned int UpdateAsync(float dt);
       bool IsAvailable();
       bool Destroy();
       cocos2d::Node* GetRootNode() const;
       cocos2d::Node* GetMainNode() const;
       cocos2d::Node* GetLightNode() const;
+      const ColorPyramid::Ptr& GetColorPyramid() const;
+      Rect GetVisiblePixelRect() const;
+      size_t GetBacklog() const;
+      const std::shared_ptr<jevo::WorldModel>& GetWorldModel() const;
+      // the bottom left corner of the view in world points, it doesn't depend on the loaded rect
+      cocos2d::Vec2 GetCameraOrigin() const;
+      void SetCamera(const cocos2d::Vec2& origin, float scale);
 
     private:
 
       typedef std::shared_ptr<PartialMap> PartialMapPtr;
       typedef std::vector<PartialMapPtr> MapList;
 
+      // moves the loaded rect, switches detail levels and applies m_worldUpdateResult to the maps
+      void UpdateMaps(float updateTime);
       void PerformMove(PartialMapsManager::CreateMapArgs& newMapsArgs,
                        PartialMapsManager::RemoveMapArgs& mapsToRemove);
       void CreateMap(const cocos2d::Rect& viewSize, float scale);
       void CreatePixelMaps(const Rect& rect, const cocos2d::Vec2& offset, float scale);
+      Rect GetRectToLoad() const;
+      // visibleRect extended to where the camera is expected to be in config::prefetchLookahead seconds
+      Rect GetPrefetchRect(const Rect& visibleRect) const;
+      void UpdateVelocity(float dt);
+      // the detail levels as steps from the finest one, DetailLevel::Texture takes a step per
+      // halving of the cell size, see m_detailThresholds
+      unsigned int GetDetailStep() const;
+      // the step for the cell size starting from the current one, see config::detailHysteresis
+      unsigned int SelectDetailStep(float cellSize) const;
+      void SetDetailStep(unsigned int step);
+      void UpdateOverviewSprite();
 
       bool RemoveMapsOutsideOfRect(const Rect& rect, const Maps& currentMaps, PartialMapsManager::RemoveMapArgs& mapsToRemove);
       bool SplitRectOnChunks(const Rect& rect, const Rect& existingRect, std::vector<Rect>& result) const;
@@ -66,8 +100,23 @@ namespace jevo
       bool m_performMove;
 
       std::shared_ptr<jevo::WorldModel> m_worldModel;
-      WorldModelDiffVect m_worldUpdateResult;
+      WorldModelDiffBuckets m_worldUpdateResult;
       PartialMapsManager m_mapManager;
+      ColorPyramid::Ptr m_colorPyramid;
+      cocos2d::Sprite* m_overviewSprite;
+      DetailLevel m_detailLevel;
+      unsigned int m_textureStep; // of DetailLevel::Texture, the maps are twice as wide on every step
+      std::vector<float> m_detailThresholds; // cell sizes, [i] separates the step i from the step i + 1
+
+      // camera velocity, cells per second and log(scale) per second
+      cocos2d::Vec2 m_panVelocity;
+      float m_zoomVelocity;
+      cocos2d::Vec2 m_prevViewCenter;
+      float m_prevLogScale;
+      bool m_hasViewSample;
+      
+      bool m_warpMode; // the maps are synced from the world instead of the diffs
+      float m_warpSyncTime; // since the last sync
 
       Rect tt_loadedPixelRect;
       cocos2d::Size tt_viewSize;
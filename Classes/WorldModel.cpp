@@ -1,14 +1,20 @@
 
 
 #include "WorldModel.h"
-#include "GraphicContext.h"
 #include "AsyncKeyFrameReader.h"
+#include "ColorPyramid.h"
+#include "Profiler.h"
+#include "Counters.h"
+#include "JobSystem.h"
+#include "UIConfig.h"
 
 namespace jevo
 {
+  // a chunk belongs to one stripe, so the stripes don't share the counters of the chunks
+  static_assert(config::applyStripeRows % SparseWorld::kChunkSize == 0, "a stripe is made of whole chunks");
+  
   Organizm::Organizm(Organizm::Id id, GreatPixel* pos, cocos2d::Color3B color)
-  : m_context(nullptr)
-  , m_color(color)
+  : m_color(color)
   , m_id(id)
   , m_pos(pos)
   {
@@ -16,10 +22,12 @@ namespace jevo
     assert(!m_pos->organizm);
     assert(color != cocos2d::Color3B());
     assert(m_id != UnknownOrgId);
+    counters::Add(counters::Counter::Organizms);
   }
   
   Organizm::~Organizm()
   {
+    counters::Add(counters::Counter::Organizms, -1);
   }
   
   void Organizm::Move(GreatPixel* pos)
@@ -55,16 +63,6 @@ namespace jevo
     return m_pos->pos;
   }
   
-  const GraphicContextPtr& Organizm::GetGraphicContext() const
-  {
-    return m_context;
-  }
-  
-  void Organizm::SetGraphicContext(const GraphicContextPtr& context)
-  {
-    m_context = context;
-  }
-  
   cocos2d::Color3B Organizm::GetColor() const
   {
     return m_color;
@@ -87,12 +85,117 @@ namespace jevo
     "[" <<
     "WorldModelDiff: " << static_cast<const void*>(this) <<
     " id: " << m_id <<
-    " context: " << (m_context ? m_context->Description() : "null") <<
     " pos: " << GetPosition().Description() <<
     "]";
     return ss.str();
   }
   
+  SparseWorld::SparseWorld(PixelPos width, PixelPos height)
+  : m_width(width)
+  , m_height(height)
+  , m_chunksPerRow((width + kChunkSize - 1) / kChunkSize)
+  {
+    PixelPos chunksPerColumn = (height + kChunkSize - 1) / kChunkSize;
+    m_chunks.resize(m_chunksPerRow * chunksPerColumn);
+  }
+  
+  SparseWorld::~SparseWorld()
+  {
+    for (const auto& chunk : m_chunks)
+    {
+      if (chunk) counters::Add(counters::Counter::WorldChunks, -1);
+    }
+  }
+  
+  size_t SparseWorld::GetChunkIndex(PixelPos x, PixelPos y) const
+  {
+    return x / kChunkSize + (y / kChunkSize) * m_chunksPerRow;
+  }
+  
+  Vec2 SparseWorld::GetChunkOrigin(size_t index) const
+  {
+    return Vec2((index % m_chunksPerRow) * kChunkSize, (index / m_chunksPerRow) * kChunkSize);
+  }
+  
+  GreatPixel* SparseWorld::Get(PixelPos x, PixelPos y) const
+  {
+    if (x < 0 || x >= m_width || y < 0 || y >= m_height)
+      return nullptr;
+    
+    const auto& chunk = m_chunks[GetChunkIndex(x, y)];
+    if (!chunk)
+      return nullptr;
+    
+    return &chunk->cells[x % kChunkSize + (y % kChunkSize) * kChunkSize];
+  }
+  
+  GreatPixel* SparseWorld::GetOrCreate(PixelPos x, PixelPos y)
+  {
+    if (x < 0 || x >= m_width || y < 0 || y >= m_height)
+      return nullptr;
+    
+    size_t index = GetChunkIndex(x, y);
+    auto& chunk = m_chunks[index];
+    if (!chunk)
+    {
+      chunk.reset(new Chunk());
+      PixelPos x0 = x - x % kChunkSize;
+      PixelPos y0 = y - y % kChunkSize;
+      for (PixelPos j = 0; j < kChunkSize; ++j)
+      {
+        for (PixelPos i = 0; i < kChunkSize; ++i)
+        {
+          chunk->cells[i + j * kChunkSize].pos = Vec2(x0 + i, y0 + j);
+        }
+      }
+      // released if nothing comes into it
+      m_releaseCandidates.push_back(index);
+      counters::Add(counters::Counter::WorldChunks);
+    }
+    
+    return &chunk->cells[x % kChunkSize + (y % kChunkSize) * kChunkSize];
+  }
+  
+  int SparseWorld::GetOccupiedCells(size_t index) const
+  {
+    const auto& chunk = m_chunks[index];
+    return chunk ? static_cast<int>(chunk->occupied) : -1;
+  }
+  
+  void SparseWorld::Occupy(const GreatPixel* pixel)
+  {
+    const auto& chunk = m_chunks[GetChunkIndex(pixel->pos.x, pixel->pos.y)];
+    assert(chunk);
+    chunk->occupied += 1;
+  }
+  
+  bool SparseWorld::Vacate(const GreatPixel* pixel)
+  {
+    const auto& chunk = m_chunks[GetChunkIndex(pixel->pos.x, pixel->pos.y)];
+    assert(chunk && chunk->occupied > 0);
+    chunk->occupied -= 1;
+    return chunk->occupied == 0;
+  }
+  
+  void SparseWorld::AddReleaseCandidate(const GreatPixel* pixel)
+  {
+    m_releaseCandidates.push_back(GetChunkIndex(pixel->pos.x, pixel->pos.y));
+  }
+  
+  void SparseWorld::ReleaseEmptyChunks()
+  {
+    for (size_t index : m_releaseCandidates)
+    {
+      auto& chunk = m_chunks[index];
+      if (chunk && chunk->occupied == 0)
+      {
+        chunk.reset();
+        counters::Add(counters::Counter::WorldChunks, -1);
+      }
+    }
+    m_releaseCandidates.clear();
+  }
+  
   std::string WorldModelDiff::Description() const
   {
     std::stringstream ss;
@@ -107,6 +210,65 @@ namespace jevo
     return ss.str();
   }
   
+  const unsigned int WorldModelDiffBuckets::kNoBucket;
+  
+  void WorldModelDiffBuckets::Clear()
+  {
+    for (size_t i = 0; i < m_bucketCount; ++i)
+    {
+      m_bucketOfChunk[m_buckets[i].chunkIndex] = kNoBucket;
+      m_buckets[i].diffs.clear();
+    }
+    m_bucketCount = 0;
+    m_crossChunkMoves.clear();
+  }
+  
+  void WorldModelDiffBuckets::Add(const WorldModelDiff& diff, size_t destinationChunk, Vec2ConstRef chunkOrigin, bool crossChunk)
+  {
+    if (crossChunk)
+    {
+      m_crossChunkMoves.push_back(diff);
+      return;
+    }
+    
+    if (destinationChunk >= m_bucketOfChunk.size())
+    {
+      m_bucketOfChunk.resize(destinationChunk + 1, kNoBucket);
+    }
+    
+    unsigned int& bucketIndex = m_bucketOfChunk[destinationChunk];
+    if (bucketIndex == kNoBucket)
+    {
+      if (m_bucketCount == m_buckets.size())
+      {
+        m_buckets.emplace_back();
+      }
+      bucketIndex = static_cast<unsigned int>(m_bucketCount);
+      m_bucketCount += 1;
+      
+      Bucket& bucket = m_buckets[bucketIndex];
+      bucket.chunkOrigin = chunkOrigin;
+      bucket.chunkIndex = destinationChunk;
+    }
+    
+    m_buckets[bucketIndex].diffs.push_back(diff);
+  }
+  
+  bool WorldModelDiffBuckets::Empty() const
+  {
+    return m_bucketCount == 0 && m_crossChunkMoves.empty();
+  }
+  
+  size_t WorldModelDiffBuckets::Size() const
+  {
+    size_t size = m_crossChunkMoves.size();
+    for (size_t i = 0; i < m_bucketCount; ++i)
+    {
+      size += m_buckets[i].diffs.size();
+    }
+    return size;
+  }
+  
   bool WorldModel::Init(const std::string& workingFolder)
   {
     m_workingFolder = workingFolder;
@@ -118,6 +280,9 @@ namespace jevo
       return false;
     }
     
+    m_stripes.resize((m_map->GetHeight() + config::applyStripeRows - 1) / config::applyStripeRows);
+    m_unsyncedChunkFlags.assign(m_map->GetNumberOfChunks(), 0);
+    
     m_diffReader = std::make_shared<AsyncDiffReader>();
     if (!m_diffReader->Init(workingFolder))
     {
@@ -132,18 +297,18 @@ namespace jevo
   {
     if (m_diffReader) m_diffReader->Stop();
     if (!m_map) return true;
-    m_map->ForEach([](const PixelPos&, const PixelPos&, const GreatPixel& pixel)
+    m_map->ForEach([](const PixelPos&, const PixelPos&, GreatPixel& pixel)
                    {
                      if (pixel.organizm) pixel.organizm->Delete();
+                     if (pixel.energy) counters::Add(counters::Counter::EnergyCells, -1);
+                     pixel.energy = false;
                    });
     return true;
   }
   
   GreatPixel* WorldModel::GetItem(Vec2ConstRef pos) const
   {
-    GreatPixel* result = nullptr;
-    m_map->Get(pos.x, pos.y, &result);
-    return result;
+    return m_map->Get(pos.x, pos.y);
   }
   
   Vec2 WorldModel::GetSize() const
@@ -151,40 +316,122 @@ namespace jevo
     return Vec2(m_map->GetWidth(), m_map->GetHeight());
   }
   
-  void WorldModel::PlayUpdates(unsigned int numberOfUpdates, Rect visibleRect, WorldModelDiffVect& updates)
+  unsigned int WorldModel::PlayUpdates(unsigned int numberOfUpdates, Rect visibleRect, WorldModelDiffBuckets& updates, bool reportDiffs)
   {
+    PROFILE_ZONE("WorldModel::PlayUpdates");
+    
+    counters::Set(counters::Counter::DiffBacklog, GetBacklog());
+    
     if (!m_pendingDiffs.empty())
     {
-      return PerformUpdates(numberOfUpdates, visibleRect, updates);
+      return PerformUpdates(numberOfUpdates, visibleRect, updates, reportDiffs);
     }
     
+    updates.Clear();
+    
     if (m_diffReader->IsAvailable())
     {
       assert(m_pendingDiffs.empty());
       m_diffReader->PopDiffs(m_pendingDiffs);
       
+      // the next file is read while these diffs are played
+      m_diffReader->LoadNext();
+      
       if (!m_pendingDiffs.empty())
       {
         m_currentPosInDiffs = 0;
-        return PerformUpdates(numberOfUpdates, visibleRect, updates);
+        return PerformUpdates(numberOfUpdates, visibleRect, updates, reportDiffs);
       }
-      else
+    }
+    
+    return 0;
+  }
+  
+  size_t WorldModel::GetBacklog() const
+  {
+    size_t backlog = m_pendingDiffs.size() - m_currentPosInDiffs;
+    if (m_diffReader) backlog += m_diffReader->GetNumberOfReadyDiffs();
+    return backlog;
+  }
+  
+  void WorldModel::TakeUnsyncedChunks(std::vector<size_t>& chunks)
+  {
+    chunks.clear();
+    chunks.swap(m_unsyncedChunks);
+    for (size_t index : chunks)
+    {
+      m_unsyncedChunkFlags[index] = 0;
+    }
+  }
+  
+  unsigned int WorldModel::PerformUpdates(unsigned int numberOfUpdates, Rect visibleRect, WorldModelDiffBuckets& result, bool reportDiffs)
+  {
+    PROFILE_ZONE("WorldModel::PerformUpdates");
+    
+    result.Clear();
+    // the cells of the previous result are not used anymore
+    m_map->ReleaseEmptyChunks();
+    
+    assert(!m_pendingDiffs.empty());
+    size_t playableUpdats = std::min<size_t>(m_pendingDiffs.size() - m_currentPosInDiffs, numberOfUpdates);
+    
+    // the stripes are played concurrently, the result is the same as the serial one:
+    // a cell gets its diffs in the played order and the shared state is changed in that order after them
+    JobSystem& jobSystem = JobSystem::GetShared();
+    bool striped = m_stripedUpdates &&
+                   m_stripes.size() > 1 &&
+                   jobSystem.GetNumberOfWorkers() > 0 &&
+                   playableUpdats >= config::stripedUpdatesMinDiffs;
+    
+    unsigned int filtered = 0;
+    unsigned int i = PlanUpdates(playableUpdats, visibleRect, reportDiffs, striped, filtered);
+    
+    if (striped)
+    {
+      jobSystem.ParallelFor(m_stripes.size(), [this](size_t index)
+                            {
+                              PlayStripe(m_stripes[index]);
+                            });
+      PlayStripe(m_serialStripe);
+      
+      for (auto& stripe : m_stripes)
       {
-        m_diffReader->LoadNext();
+        FinishStripe(stripe);
       }
+      m_plannedCells.clear();
+    }
+    FinishStripe(m_serialStripe);
+    
+    for (const auto& diff : m_plannedDiffs)
+    {
+      if (diff.hasResult) AddResult(diff.result, result);
     }
+    m_plannedDiffs.clear();
+    
+    m_currentPosInDiffs += i;
+    if (m_currentPosInDiffs == m_pendingDiffs.size())
+    {
+      m_pendingDiffs.clear();
+      m_currentPosInDiffs = 0;
+    }
+    
+    m_updateId += 1;
+    m_playedDiffs += i;
+    
+    counters::Add(counters::Counter::DiffsApplied, i);
+    counters::Add(counters::Counter::DiffsFiltered, filtered);
+    
+    return i;
   }
   
-  void WorldModel::PerformUpdates(unsigned int numberOfUpdates, Rect visibleRect, WorldModelDiffVect& result)
+  unsigned int WorldModel::PlanUpdates(size_t numberOfUpdates, Rect visibleRect, bool reportDiffs, bool striped, unsigned int& filtered)
   {
-    result.clear();
-    result.reserve(numberOfUpdates);
+    PROFILE_ZONE("WorldModel::PlanUpdates");
     
-    assert(!m_pendingDiffs.empty());
-    size_t playableUpdats = m_pendingDiffs.size() - m_currentPosInDiffs;
+    if (striped) m_plannedCells.reserve(numberOfUpdates * 2);
     
     unsigned int i = 0;
-    while(i < playableUpdats && result.size() < numberOfUpdates)
+    while(i < numberOfUpdates)
     {
       unsigned int diffIndex = m_currentPosInDiffs + i;
       const DiffItem& diff = m_pendingDiffs.at(diffIndex);
@@ -192,154 +439,413 @@ namespace jevo
       auto soursePos = Vec2(diff.sourseX - 1, diff.sourseY - 1);
       auto destPos = Vec2(diff.destX - 1, diff.destY - 1);
       
-      bool bypassResult = soursePos.In(visibleRect) || destPos.In(visibleRect);
+      bool bypassResult = reportDiffs &&
+                          (soursePos.In(visibleRect) || destPos.In(visibleRect) ||
+                           InCachedRects(soursePos) || InCachedRects(destPos));
       
+      // an empty source of an "add" may have no chunk, the destination gets one unless it is removed from.
+      // The chunks are created here, so the stripes don't change the list of them
       auto sourceItem = GetItem(soursePos);
-      assert(sourceItem);
-      auto destItem = GetItem(destPos);
+      auto destItem = diff.type == DiffType::Delete ? GetItem(destPos) : m_map->GetOrCreate(destPos.x, destPos.y);
       assert(destItem);
       
-      OrganizmPtr organizm = sourceItem->organizm;
-      if (organizm)
+      // the energy has no organizm, it is not limited to one diff per update.
+      // When striped the organizm is the one of the source after the planned diffs, they may be not played yet,
+      // the planned cell tells if it has a diff in this update, so the organizm itself is not read
+      if (sourceItem && striped)
       {
-        if (organizm->GetUpdateNumber() == m_updateId)
-        {
+        PlannedCell source = GetPlannedCell(sourceItem);
+        if (source.created || source.updated)
           break;
-        }
-        else
+        
+        if (source.organizm)
         {
-          organizm->SetUpdateNumber(m_updateId);
+          source.updated = true;
+          SetPlannedCell(source);
         }
       }
+      else if (sourceItem && sourceItem->organizm)
+      {
+        Organizm* organizm = sourceItem->organizm.get();
+        if (organizm->GetUpdateNumber() == m_updateId)
+          break;
+        
+        organizm->SetUpdateNumber(m_updateId);
+      }
       
       i += 1;
+      if (!bypassResult) filtered += 1;
       
-      Organizm::Id OrgId = diff.id == 0 ? Organizm::EnergyId : diff.id;
+      if (diff.skipped)
+        continue;
       
-      if (diff.action == "remove")
+      assert(diff.type != DiffType::Add || diff.color != cocos2d::Color3B());
+      
+      PlannedDiff planned;
+      planned.type = diff.type;
+      planned.orgId = diff.id == 0 ? Organizm::EnergyId : diff.id;
+      planned.color = diff.color;
+      planned.sourceItem = sourceItem;
+      planned.destItem = destItem;
+      planned.bypassResult = bypassResult;
+      planned.suppressed = !reportDiffs;
+      m_plannedDiffs.push_back(planned);
+      
+      if (striped)
       {
-        Delete(OrgId, destItem, bypassResult, result);
+        AssignStripe(static_cast<unsigned int>(m_plannedDiffs.size() - 1));
       }
-      else if (diff.action == "add")
+      else
       {
-        assert(diff.color != cocos2d::Color3B());
-        Create(OrgId, diff.color, destItem, bypassResult, result);
+        PlayDiff(m_plannedDiffs.back(), m_serialStripe);
       }
-      else if (diff.action == "move")
+    }
+    
+    return i;
+  }
+  
+  WorldModel::PlannedCell WorldModel::GetPlannedCell(GreatPixel* item) const
+  {
+    unsigned int slot = item->plannedSlot;
+    if (slot < m_plannedCells.size() && m_plannedCells[slot].item == item)
+      return m_plannedCells[slot];
+    
+    PlannedCell cell;
+    cell.item = item;
+    cell.organizm = item->organizm.get();
+    return cell;
+  }
+  
+  void WorldModel::SetPlannedCell(const PlannedCell& cell)
+  {
+    unsigned int& slot = cell.item->plannedSlot;
+    if (slot < m_plannedCells.size() && m_plannedCells[slot].item == cell.item)
+    {
+      m_plannedCells[slot] = cell;
+      return;
+    }
+    
+    slot = static_cast<unsigned int>(m_plannedCells.size());
+    m_plannedCells.push_back(cell);
+  }
+  
+  void WorldModel::AssignStripe(unsigned int diffIndex)
+  {
+    const PlannedDiff& diff = m_plannedDiffs[diffIndex];
+    bool move = diff.type == DiffType::Move;
+    
+    PlannedCell dest = GetPlannedCell(diff.destItem);
+    PlannedCell source = move ? GetPlannedCell(diff.sourceItem) : PlannedCell();
+    
+    // a move between the stripes changes two of them, it is played after them with the later diffs of its cells
+    size_t stripeIndex = GetStripeIndex(diff.destItem);
+    bool serial = dest.serial || (move && (source.serial || GetStripeIndex(diff.sourceItem) != stripeIndex));
+    DiffStripe& stripe = serial ? m_serialStripe : m_stripes[stripeIndex];
+    stripe.diffs.push_back(diffIndex);
+    
+    // the energy doesn't change the organizms of the cells
+    if (diff.orgId != Organizm::EnergyId)
+    {
+      switch (diff.type)
       {
-        Move(OrgId, diff.color, sourceItem, destItem, bypassResult, result);
+        case DiffType::Move:
+          dest.organizm = source.organizm;
+          dest.created = source.created;
+          dest.updated = source.updated;
+          source.organizm = nullptr;
+          source.created = false;
+          source.updated = false;
+          break;
+        case DiffType::Delete:
+          dest.organizm = nullptr;
+          dest.created = false;
+          dest.updated = false;
+          break;
+        case DiffType::Add:
+          dest.organizm = nullptr;
+          dest.created = true;
+          dest.updated = false;
+          break;
+        case DiffType::Paint:
+          break;
       }
     }
     
-    m_currentPosInDiffs += i;
-    if (m_currentPosInDiffs == m_pendingDiffs.size())
+    dest.serial = dest.serial || serial;
+    SetPlannedCell(dest);
+    if (move)
     {
-      m_pendingDiffs.clear();
-      m_currentPosInDiffs = 0;
+      source.serial = source.serial || serial;
+      SetPlannedCell(source);
+    }
+  }
+  
+  size_t WorldModel::GetStripeIndex(const GreatPixel* item) const
+  {
+    return static_cast<size_t>(item->pos.y) / config::applyStripeRows;
+  }
+  
+  void WorldModel::PlayStripe(DiffStripe& stripe)
+  {
+    for (unsigned int diffIndex : stripe.diffs)
+    {
+      PlayDiff(m_plannedDiffs[diffIndex], stripe);
+    }
+  }
+  
+  void WorldModel::FinishStripe(DiffStripe& stripe)
+  {
+    if (m_colorPyramid)
+    {
+      for (const auto& pos : stripe.dirtyCells)
+      {
+        m_colorPyramid->SetCellDirty(pos);
+      }
     }
     
-    m_updateId += 1;
+    for (const GreatPixel* pixel : stripe.emptiedCells)
+    {
+      m_map->AddReleaseCandidate(pixel);
+    }
+    
+    m_unsyncedChunks.insert(m_unsyncedChunks.end(), stripe.unsyncedChunks.begin(), stripe.unsyncedChunks.end());
+    
+    stripe.diffs.clear();
+    stripe.dirtyCells.clear();
+    stripe.emptiedCells.clear();
+    stripe.unsyncedChunks.clear();
+  }
+  
+  void WorldModel::PlayDiff(PlannedDiff& diff, DiffStripe& stripe)
+  {
+    switch (diff.type)
+    {
+      case DiffType::Add:
+        Create(diff, stripe);
+        break;
+      case DiffType::Move:
+        Move(diff, stripe);
+        break;
+      case DiffType::Delete:
+        Delete(diff, stripe);
+        break;
+      case DiffType::Paint:
+        Paint(diff, stripe);
+        break;
+    }
+    
+    if (diff.suppressed)
+    {
+      MarkUnsynced(diff.destItem, stripe);
+      if (diff.type == DiffType::Move) MarkUnsynced(diff.sourceItem, stripe);
+    }
+  }
+
+  bool WorldModel::InCachedRects(Vec2ConstRef pos) const
+  {
+    for (const auto& rect : m_cachedRects)
+    {
+      if (pos.In(rect))
+        return true;
+    }
+    return false;
   }
   
-  void WorldModel::Move(Organizm::Id orgId,
-                        cocos2d::Color3B color,
-                        GreatPixel* sourceItem,
-                        GreatPixel* destItem,
-                        bool bypassResult,
-                        WorldModelDiffVect& result)
+  void WorldModel::Move(PlannedDiff& diff, DiffStripe& stripe)
   {
+    GreatPixel* sourceItem = diff.sourceItem;
+    GreatPixel* destItem = diff.destItem;
+    
     assert(destItem);
     assert(sourceItem);
+    assert(!destItem->energy);
+    
+    if (diff.orgId == Organizm::EnergyId)
+    {
+      assert(sourceItem->energy);
+      SetEnergy(destItem, sourceItem->energyColor, stripe);
+      ClearEnergy(sourceItem, stripe);
+      AddEnergyResult(DiffType::Move, sourceItem, destItem, diff);
+      return;
+    }
     
     OrganizmPtr organizm = sourceItem->organizm;
     
     assert(organizm);
-    assert(organizm->GetId() == orgId);
+    assert(organizm->GetId() == diff.orgId);
     
     organizm->Move(destItem);
+    m_map->Occupy(destItem);
+    Vacate(sourceItem, stripe);
     
-    if (bypassResult)
+    stripe.dirtyCells.push_back(sourceItem->pos);
+    stripe.dirtyCells.push_back(destItem->pos);
+    
+    if (diff.bypassResult)
     {
-      WorldModelDiff resultDiff;
+      WorldModelDiff& resultDiff = diff.result;
       resultDiff.organizm = organizm;
       resultDiff.sourcePos = sourceItem->pos;
       resultDiff.destinationPos = destItem->pos;
       resultDiff.destinationPixel = destItem;
       resultDiff.type = DiffType::Move;
-      
-      result.push_back(resultDiff);
+      diff.hasResult = true;
     }
   }
   
-  void WorldModel::Delete(Organizm::Id orgId, GreatPixel* sourceItem, bool bypassResult, WorldModelDiffVect& result)
+  void WorldModel::Delete(PlannedDiff& diff, DiffStripe& stripe)
   {
-    assert(sourceItem);
+    GreatPixel* item = diff.destItem;
+    assert(item);
     
-    OrganizmPtr organizm = sourceItem->organizm;
+    if (diff.orgId == Organizm::EnergyId)
+    {
+      assert(item->energy);
+      ClearEnergy(item, stripe);
+      AddEnergyResult(DiffType::Delete, item, item, diff);
+      return;
+    }
+    
+    OrganizmPtr organizm = item->organizm;
     assert(organizm);
     
     organizm->Delete();
+    Vacate(item, stripe);
     
-    if (bypassResult)
+    stripe.dirtyCells.push_back(item->pos);
+    
+    if (diff.bypassResult)
     {
-      WorldModelDiff resultDiff;
+      WorldModelDiff& resultDiff = diff.result;
       resultDiff.organizm = organizm;
-      resultDiff.sourcePos = sourceItem->pos;
-      resultDiff.destinationPos = sourceItem->pos;
-      resultDiff.destinationPixel = sourceItem;
+      resultDiff.sourcePos = item->pos;
+      resultDiff.destinationPos = item->pos;
+      resultDiff.destinationPixel = item;
       resultDiff.type = DiffType::Delete;
-      
-      result.push_back(resultDiff);
+      diff.hasResult = true;
     }
   }
   
-  void WorldModel::Create(Organizm::Id orgId, cocos2d::Color3B color, GreatPixel* sourceItem, bool bypassResult, WorldModelDiffVect& result)
+  void WorldModel::Create(PlannedDiff& diff, DiffStripe& stripe)
   {
-    assert(sourceItem);
+    GreatPixel* item = diff.destItem;
+    assert(item);
+    assert(!item->energy || diff.orgId == Organizm::EnergyId);
     
-    if (sourceItem->organizm
-        && sourceItem->organizm->GetId() == 0
-        && orgId == 0)
+    if (diff.orgId == Organizm::EnergyId)
     {
+      if (item->energy)
+        return;
+      
+      SetEnergy(item, diff.color, stripe);
+      AddEnergyResult(DiffType::Add, item, item, diff);
       return;
     }
     
-    auto organizm = std::make_shared<Organizm>(orgId, sourceItem, color);
+    auto organizm = std::make_shared<Organizm>(diff.orgId, item, diff.color);
     organizm->SetUpdateNumber(m_updateId);
-    sourceItem->organizm = organizm;
+    item->organizm = organizm;
+    m_map->Occupy(item);
+    
+    stripe.dirtyCells.push_back(item->pos);
     
-    if (bypassResult)
+    if (diff.bypassResult)
     {
-      WorldModelDiff resultDiff;
+      WorldModelDiff& resultDiff = diff.result;
       resultDiff.organizm = organizm;
-      resultDiff.sourcePos = sourceItem->pos;
-      resultDiff.destinationPos = sourceItem->pos;
-      resultDiff.destinationPixel = sourceItem;
+      resultDiff.sourcePos = item->pos;
+      resultDiff.destinationPos = item->pos;
+      resultDiff.destinationPixel = item;
       resultDiff.type = DiffType::Add;
-      
-      result.push_back(resultDiff);
+      diff.hasResult = true;
     }
   }
   
-  void WorldModel::Paint(Organizm::Id orgId, cocos2d::Color3B color, GreatPixel* sourceItem, bool bypassResult, WorldModelDiffVect& result)
+  void WorldModel::Paint(PlannedDiff& diff, DiffStripe& stripe)
   {
-    assert(sourceItem);
+    GreatPixel* item = diff.destItem;
+    assert(item);
     
-    OrganizmPtr organizm = sourceItem->organizm;
+    OrganizmPtr organizm = item->organizm;
     assert(organizm);
-
-    organizm->ChangeColor(color);
     
-    if (bypassResult)
+    organizm->ChangeColor(diff.color);
+    
+    stripe.dirtyCells.push_back(item->pos);
+    
+    if (diff.bypassResult)
     {
-      WorldModelDiff resultDiff;
+      WorldModelDiff& resultDiff = diff.result;
       resultDiff.organizm = organizm;
-      resultDiff.sourcePos = sourceItem->pos;
-      resultDiff.destinationPos = sourceItem->pos;
-      resultDiff.destinationPixel = sourceItem;
+      resultDiff.sourcePos = item->pos;
+      resultDiff.destinationPos = item->pos;
+      resultDiff.destinationPixel = item;
       resultDiff.type = DiffType::Paint;
-      
-      result.push_back(resultDiff);
+      diff.hasResult = true;
     }
   }
+
+  void WorldModel::AddResult(const WorldModelDiff& diff, WorldModelDiffBuckets& result)
+  {
+    const PixelPos chunkSize = SparseWorld::kChunkSize;
+    Vec2ConstRef pos = diff.destinationPos;
+    size_t destinationChunk = m_map->GetChunkIndex(pos.x, pos.y);
+    bool crossChunk = m_map->GetChunkIndex(diff.sourcePos.x, diff.sourcePos.y) != destinationChunk;
+    result.Add(diff, destinationChunk, Vec2((pos.x / chunkSize) * chunkSize, (pos.y / chunkSize) * chunkSize), crossChunk);
+  }
+  
+  void WorldModel::SetEnergy(GreatPixel* item, cocos2d::Color3B color, DiffStripe& stripe)
+  {
+    assert(!item->organizm && !item->energy);
+    item->energy = true;
+    item->energyColor = color;
+    m_map->Occupy(item);
+    counters::Add(counters::Counter::EnergyCells);
+    
+    stripe.dirtyCells.push_back(item->pos);
+  }
+  
+  void WorldModel::ClearEnergy(GreatPixel* item, DiffStripe& stripe)
+  {
+    assert(item->energy);
+    item->energy = false;
+    Vacate(item, stripe);
+    counters::Add(counters::Counter::EnergyCells, -1);
+    
+    stripe.dirtyCells.push_back(item->pos);
+  }
+  
+  void WorldModel::Vacate(GreatPixel* item, DiffStripe& stripe)
+  {
+    if (m_map->Vacate(item))
+    {
+      stripe.emptiedCells.push_back(item);
+    }
+  }
+  
+  void WorldModel::MarkUnsynced(const GreatPixel* item, DiffStripe& stripe)
+  {
+    size_t index = m_map->GetChunkIndex(item->pos.x, item->pos.y);
+    if (m_unsyncedChunkFlags[index])
+      return;
+    
+    m_unsyncedChunkFlags[index] = 1;
+    stripe.unsyncedChunks.push_back(index);
+  }
+  
+  void WorldModel::AddEnergyResult(DiffType type, GreatPixel* sourceItem, GreatPixel* destItem, PlannedDiff& diff)
+  {
+    if (!diff.bypassResult)
+      return;
+    
+    WorldModelDiff& resultDiff = diff.result;
+    resultDiff.energy = true;
+    // a deleted energy keeps its color in the cell
+    resultDiff.energyColor = destItem->energy ? destItem->energyColor : sourceItem->energyColor;
+    resultDiff.sourcePos = sourceItem->pos;
+    resultDiff.destinationPos = destItem->pos;
+    resultDiff.destinationPixel = destItem;
+    resultDiff.type = type;
+    diff.hasResult = true;
+  }
 }
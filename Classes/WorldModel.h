@@ -13,13 +13,11 @@ namespace jevo
 {
   namespace graphic
   {
-    class GraphicContext;
+    class ColorPyramid;
   }
   
   class AsyncKeyFrameReader;
   
-  using GraphicContextPtr = std::shared_ptr<graphic::GraphicContext>;
-
   class GreatPixel;
   
   class Organizm
@@ -40,8 +38,6 @@ namespace jevo
     
     Id GetId() const;
     Vec2 GetPosition() const;
-    const GraphicContextPtr& GetGraphicContext() const;
-    void SetGraphicContext(const GraphicContextPtr& context);
     cocos2d::Color3B GetColor() const;
     uint64_t GetUpdateNumber() const;
     void SetUpdateNumber(uint64_t updateId);
@@ -49,7 +45,6 @@ namespace jevo
     std::string Description() const;
     
   private:
-    GraphicContextPtr m_context;
     cocos2d::Color3B m_color;
     Id m_id = UnknownOrgId;
     uint64_t m_updateNumber = 0;
@@ -65,33 +60,159 @@ namespace jevo
   public:
     OrganizmPtr organizm;
     Vec2 pos;
+    // energy (Organizm::EnergyId) is a flag of the cell instead of an organizm, a cell has one or the other
+    bool energy = false;
+    cocos2d::Color3B energyColor;
+    // index of the cell in WorldModel::m_plannedCells while an update is planned, valid when that planned cell
+    // points back to this one. It fits the padding of the cell on the 64 bit targets
+    unsigned int plannedSlot = 0;
+    
+    bool IsEmpty() const { return !organizm && !energy; }
+    cocos2d::Color3B GetColor() const { return organizm ? organizm->GetColor() : energyColor; }
   };
   
-  using BufferType = Buffer2D<GreatPixel>;
-  using BufferTypePtr = std::shared_ptr<BufferType>;
-  
-  enum class DiffType
+  // Cells of the world in square chunks. A chunk is allocated when an organizm comes to one of its
+  // cells and released when the last one leaves, so the memory follows the occupied area, not the size.
+  // The cells of a chunk are contiguous, a chunk has the size of a map of kSegmentSize.
+  class SparseWorld
   {
-    Add,
-    Move,
-    Delete,
-    Paint
+  public:
+    
+    static const PixelPos kChunkSize = 50;
+    
+    SparseWorld(PixelPos width, PixelPos height);
+    ~SparseWorld();
+    
+    PixelPos GetWidth() const { return m_width; }
+    PixelPos GetHeight() const { return m_height; }
+    
+    // nullptr outside of the world and in the chunks which are not allocated, they are empty
+    GreatPixel* Get(PixelPos x, PixelPos y) const;
+    // allocates the chunk, nullptr outside of the world
+    GreatPixel* GetOrCreate(PixelPos x, PixelPos y);
+    // the organizm or the energy of the cell is set or cleared. Chunks in different rows of chunks
+    // may be changed concurrently. Vacate returns true when the chunk became empty,
+    // pass the pixel to AddReleaseCandidate then
+    void Occupy(const GreatPixel* pixel);
+    bool Vacate(const GreatPixel* pixel);
+    void AddReleaseCandidate(const GreatPixel* pixel);
+    // releases the chunks which became empty or were allocated without an organizm,
+    // the cells of the released chunks may still be referenced until this call
+    void ReleaseEmptyChunks();
+    size_t GetChunkIndex(PixelPos x, PixelPos y) const;
+    size_t GetNumberOfChunks() const { return m_chunks.size(); }
+    Vec2 GetChunkOrigin(size_t index) const;
+    // occupied cells of the chunk, -1 when it is not allocated
+    int GetOccupiedCells(size_t index) const;
+    
+    // cells of the allocated chunks
+    template <typename F>
+    void ForEach(F&& onValue)
+    {
+      for (auto& chunk : m_chunks)
+      {
+        if (!chunk) continue;
+        for (auto& pixel : chunk->cells)
+        {
+          onValue(pixel.pos.x, pixel.pos.y, pixel);
+        }
+      }
+    }
+    
+  private:
+    
+    struct Chunk
+    {
+      GreatPixel cells[kChunkSize * kChunkSize];
+      unsigned int occupied = 0;
+    };
+    
+    PixelPos m_width;
+    PixelPos m_height;
+    PixelPos m_chunksPerRow;
+    std::vector<std::unique_ptr<Chunk>> m_chunks;
+    std::vector<size_t> m_releaseCandidates;
   };
   
+  using BufferType = SparseWorld;
+  using BufferTypePtr = std::shared_ptr<BufferType>;
+  
   class WorldModelDiff
   {
   public:
     DiffType type;
-    OrganizmPtr organizm;
+    OrganizmPtr organizm; // nullptr for the energy
     GreatPixel* destinationPixel;
     Vec2 sourcePos;
     Vec2 destinationPos;
+    bool energy = false;
+    cocos2d::Color3B energyColor;
     
     std::string Description() const;
   };
   
   using WorldModelDiffVect = std::vector<WorldModelDiff>;
   
+  // Reported diffs grouped by the chunk of the world (SparseWorld::kChunkSize) of their destination,
+  // in the played order inside a chunk, so a chunk is handled in one go. A move from another chunk
+  // touches two of them, such moves are kept apart in the played order.
+  // The buckets keep their memory between the updates.
+  class WorldModelDiffBuckets
+  {
+  public:
+    
+    struct Bucket
+    {
+      Vec2 chunkOrigin;
+      size_t chunkIndex = 0;
+      WorldModelDiffVect diffs;
+    };
+    
+    void Clear();
+    void Add(const WorldModelDiff& diff, size_t destinationChunk, Vec2ConstRef chunkOrigin, bool crossChunk);
+    bool Empty() const;
+    // number of diffs
+    size_t Size() const;
+    
+    size_t GetBucketCount() const { return m_bucketCount; }
+    const Bucket& GetBucket(size_t index) const { return m_buckets[index]; }
+    const WorldModelDiffVect& GetCrossChunkMoves() const { return m_crossChunkMoves; }
+    
+  private:
+    
+    static const unsigned int kNoBucket = ~0u;
+    
+    std::vector<Bucket> m_buckets; // [0, m_bucketCount) are used
+    size_t m_bucketCount = 0;
+    std::vector<unsigned int> m_bucketOfChunk; // by SparseWorld::GetChunkIndex
+    WorldModelDiffVect m_crossChunkMoves;
+  };
+  
+  // A played diff with its cells, planned in the played order before it is played by a stripe
+  struct PlannedDiff
+  {
+    DiffType type;
+    Organizm::Id orgId;
+    cocos2d::Color3B color;
+    GreatPixel* sourceItem;
+    GreatPixel* destItem;
+    bool bypassResult;
+    bool suppressed; // played with reportDiffs false, the maps are synced from the world later
+    // filled when the diff is played, added to the buckets in the played order after all the stripes
+    bool hasResult = false;
+    WorldModelDiff result;
+  };
+  
+  // Diffs of a band of config::applyStripeRows rows of the world, played by one job. A stripe changes
+  // only its own cells and chunks, the changes of the shared state wait here until all the stripes are done.
+  struct DiffStripe
+  {
+    std::vector<unsigned int> diffs; // indices of WorldModel::m_plannedDiffs in the played order
+    std::vector<Vec2> dirtyCells; // of the color pyramid
+    std::vector<const GreatPixel*> emptiedCells; // their chunks became empty
+    std::vector<size_t> unsyncedChunks; // see WorldModel::TakeUnsyncedChunks
+  };
+  
   class WorldModel
   {
   public:
@@ -100,26 +221,73 @@ namespace jevo
     bool Stop();
     GreatPixel* GetItem(Vec2ConstRef pos) const;
     Vec2 GetSize() const;
-    void PlayUpdates(unsigned int numberOfUpdates, Rect visibleRect, WorldModelDiffVect& updates);
-    void PerformUpdates(unsigned int numberOfUpdates, Rect visibleRect, WorldModelDiffVect& result);
-    
-    void Move(Organizm::Id orgId,
-              cocos2d::Color3B color,
-              GreatPixel* sourceItem,
-              GreatPixel* destItem,
-              bool bypassResult,
-              WorldModelDiffVect& result);
-    void Delete(Organizm::Id orgId, GreatPixel* sourceItem, bool bypassResult, WorldModelDiffVect& result);
-    void Create(Organizm::Id orgId, cocos2d::Color3B color, GreatPixel* sourceItem, bool bypassResult, WorldModelDiffVect& result);
-    void Paint(Organizm::Id orgId, cocos2d::Color3B color, GreatPixel* sourceItem, bool bypassResult, WorldModelDiffVect& result);
+    // plays up to numberOfUpdates diffs, returns the number of played ones.
+    // diffs of visibleRect and m_cachedRects go to updates unless reportDiffs is false
+    unsigned int PlayUpdates(unsigned int numberOfUpdates, Rect visibleRect, WorldModelDiffBuckets& updates, bool reportDiffs = true);
+    // at least config::stripedUpdatesMinDiffs diffs are played by the stripes of the world on the JobSystem,
+    // the world, the result and the counters are the same as after playing them one by one
+    unsigned int PerformUpdates(unsigned int numberOfUpdates, Rect visibleRect, WorldModelDiffBuckets& result, bool reportDiffs = true);
+    // diffs which are read but not played yet
+    size_t GetBacklog() const;
+    // chunks changed by the diffs played with reportDiffs false since the last call, each one once
+    void TakeUnsyncedChunks(std::vector<size_t>& chunks);
+    
+    // plans up to numberOfUpdates diffs to m_plannedDiffs, returns the number of played ones.
+    // Unless striped the diffs are played right away, otherwise they are put to the stripes
+    unsigned int PlanUpdates(size_t numberOfUpdates, Rect visibleRect, bool reportDiffs, bool striped, unsigned int& filtered);
+    void AssignStripe(unsigned int diffIndex);
+    size_t GetStripeIndex(const GreatPixel* item) const;
+    void PlayStripe(DiffStripe& stripe);
+    // applies the changes of the shared state kept by the stripe
+    void FinishStripe(DiffStripe& stripe);
+    
+    void PlayDiff(PlannedDiff& diff, DiffStripe& stripe);
+    void Move(PlannedDiff& diff, DiffStripe& stripe);
+    void Delete(PlannedDiff& diff, DiffStripe& stripe);
+    void Create(PlannedDiff& diff, DiffStripe& stripe);
+    void Paint(PlannedDiff& diff, DiffStripe& stripe);
+    bool InCachedRects(Vec2ConstRef pos) const;
+    void SetEnergy(GreatPixel* item, cocos2d::Color3B color, DiffStripe& stripe);
+    void ClearEnergy(GreatPixel* item, DiffStripe& stripe);
+    void Vacate(GreatPixel* item, DiffStripe& stripe);
+    void MarkUnsynced(const GreatPixel* item, DiffStripe& stripe);
+    void AddEnergyResult(DiffType type, GreatPixel* sourceItem, GreatPixel* destItem, PlannedDiff& diff);
+    
+    // puts the diff to the bucket of its destination chunk
+    void AddResult(const WorldModelDiff& diff, WorldModelDiffBuckets& result);
     
     std::string m_workingFolder;
     BufferTypePtr m_map;
     bool inited = false;
-    WorldModelDiffVect m_outputUpdates;
     std::shared_ptr<AsyncDiffReader> m_diffReader;
     DiffItemVector m_pendingDiffs;
     unsigned int m_currentPosInDiffs = 0;
     uint32_t m_updateId = 1;
+    uint64_t m_playedDiffs = 0; // since the keyframe
+    std::shared_ptr<graphic::ColorPyramid> m_colorPyramid;
+    std::vector<Rect> m_cachedRects; // maps cached off the screen, their diffs are reported as well
+    
+    // A cell as it is after the planned diffs, only the cells touched by them are kept
+    struct PlannedCell
+    {
+      GreatPixel* item = nullptr;
+      Organizm* organizm = nullptr;
+      bool created = false; // by a planned diff, the organizm doesn't exist yet
+      bool updated = false; // the organizm is the source of a planned diff, see Organizm::GetUpdateNumber
+      bool serial = false; // touched by a diff of m_serialStripe, the later diffs of the cell go there too
+    };
+    PlannedCell GetPlannedCell(GreatPixel* item) const;
+    void SetPlannedCell(const PlannedCell& cell);
+    
+    // false plays all the updates serially, see PerformUpdates
+    bool m_stripedUpdates = true;
+    std::vector<PlannedDiff> m_plannedDiffs;
+    std::vector<PlannedCell> m_plannedCells; // of the current update, see GreatPixel::plannedSlot
+    std::vector<DiffStripe> m_stripes;
+    // the moves between the stripes and the later diffs of their cells, played after the stripes
+    DiffStripe m_serialStripe;
+    // a flag per chunk of the world, a chunk is changed by one stripe so the flags are not shared
+    std::vector<uint8_t> m_unsyncedChunkFlags;
+    std::vector<size_t> m_unsyncedChunks;
   };
 }
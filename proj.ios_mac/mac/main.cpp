@@ -30,6 +30,7 @@ USING_NS_CC;
 int main(int argc, char *argv[])
 {
   AppDelegate app;
-  return Application::getInstance()->run();
+  int result = Application::getInstance()->run();
+  return result != EXIT_SUCCESS ? result : AppDelegate::GetExitCode();
 
 }
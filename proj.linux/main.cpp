@@ -11,5 +11,6 @@ int main(int argc, char **argv)
 {
     // create the application instance
     AppDelegate app;
-    return Application::getInstance()->run();
+    int result = Application::getInstance()->run();
+    return result != EXIT_SUCCESS ? result : AppDelegate::GetExitCode();
 }
@@ -16,5 +16,6 @@ int APIENTRY _tWinMain(HINSTANCE hInstance,
 
     // create the application instance
     AppDelegate app;
-    return Application::getInstance()->run();
+    int result = Application::getInstance()->run();
+    return result != EXIT_SUCCESS ? result : AppDelegate::GetExitCode();
 }